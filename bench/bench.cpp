@@ -0,0 +1,354 @@
+/*
+ * Generates a synthetic corpus at a given scale, runs metatool over it and prints one JSON object per line with the
+ * results, so runs can be diffed or collected over time to spot regressions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+struct Config {
+    int structCount;
+    int memberCount;
+    int enumCount;
+    int enumSize;
+    int enumSparsity;   // Gap between consecutive enum values, 1 is dense
+    int commentDensity; // Percentage of members followed by a comment
+    int stringDensity;  // Percentage of structs followed by an array of string literals
+    int runs;
+    uint64_t seed;
+};
+
+struct RunResult {
+    double wallSeconds;
+    long peakRssKilobytes;
+    char *capturedOutput;
+};
+
+static void
+fatal(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(1);
+}
+
+static double
+getSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Corpus generation
+ */
+
+// xorshift64*, so a seed always produces the same corpus on every platform
+static uint64_t
+nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+static int
+randomBelow(uint64_t *state, int limit) {
+    return (int)(nextRandom(state) % (uint64_t)limit);
+}
+
+static const char *memberTypes[] = {
+    "int", "float", "double", "char", "bool", "uint8_t", "uint16_t", "uint32_t", "uint64_t", "int32_t", "int64_t",
+};
+
+static const char *fillerWords[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliet", "kilo", "lima",
+};
+
+static void
+writeFillerText(FILE *file, uint64_t *random, int wordCount) {
+    for (int i = 0; i < wordCount; i++) {
+        fprintf(file, "%s%s", i ? " " : "", fillerWords[randomBelow(random, sizeof(fillerWords) / sizeof(fillerWords[0]))]);
+    }
+}
+
+/*
+ * Every struct can use the enums and the structs declared before it as member types, so the output exercises
+ * nested types as well as the built in ones.
+ */
+static void
+generateCorpus(Config *config, FILE *file) {
+    uint64_t random = config->seed ? config->seed : 1;
+    int typeCount = sizeof(memberTypes) / sizeof(memberTypes[0]);
+
+    fprintf(file, "#include <stdint.h>\n#define Introspect(...)\n\n");
+
+    for (int e = 0; e < config->enumCount; e++) {
+        fprintf(file, "Introspect()\nenum BenchEnum%d {\n", e);
+        for (int i = 0; i < config->enumSize; i++) {
+            fprintf(file, "    BenchEnum%d_Value%d = %d,\n", e, i, i * config->enumSparsity);
+        }
+        fprintf(file, "};\n\n");
+    }
+
+    for (int s = 0; s < config->structCount; s++) {
+        fprintf(file, "Introspect()\nstruct BenchStruct%d {\n", s);
+        for (int m = 0; m < config->memberCount; m++) {
+            int kind = randomBelow(&random, 10);
+            if (kind == 0 && s > 0) {
+                fprintf(file, "    BenchStruct%d member%d;", randomBelow(&random, s), m);
+            } else if (kind == 1 && config->enumCount) {
+                fprintf(file, "    BenchEnum%d member%d;", randomBelow(&random, config->enumCount), m);
+            } else if (kind == 2) {
+                fprintf(file, "    char *member%d;", m);
+            } else if (kind == 3) {
+                fprintf(file, "    %s member%d[%d];", memberTypes[randomBelow(&random, typeCount)], m, 1 + randomBelow(&random, 16));
+            } else {
+                fprintf(file, "    %s member%d;", memberTypes[randomBelow(&random, typeCount)], m);
+            }
+
+            if (randomBelow(&random, 100) < config->commentDensity) {
+                if (randomBelow(&random, 2)) {
+                    fprintf(file, " // ");
+                    writeFillerText(file, &random, 4 + randomBelow(&random, 8));
+                } else {
+                    fprintf(file, " /* ");
+                    writeFillerText(file, &random, 4 + randomBelow(&random, 8));
+                    fprintf(file, " */");
+                }
+            }
+            fprintf(file, "\n");
+        }
+        fprintf(file, "};\n\n");
+
+        if (randomBelow(&random, 100) < config->stringDensity) {
+            fprintf(file, "static const char *benchStrings%d[] = {\n", s);
+            int stringCount = 2 + randomBelow(&random, 6);
+            for (int i = 0; i < stringCount; i++) {
+                fprintf(file, "    \"");
+                writeFillerText(file, &random, 3 + randomBelow(&random, 10));
+                fprintf(file, " \\\"struct Fake { int x; };\\\"\",\n");
+            }
+            fprintf(file, "};\n\n");
+        }
+    }
+}
+
+/*
+ * Running metatool
+ */
+
+static char *
+readAll(int fd) {
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *data = (char *)malloc(capacity);
+    for (;;) {
+        if (size + 1 == capacity) {
+            capacity *= 2;
+            data = (char *)realloc(data, capacity);
+        }
+        ssize_t bytesRead = read(fd, data + size, capacity - size - 1);
+        if (bytesRead <= 0) break;
+        size += bytesRead;
+    }
+    data[size] = '\0';
+    return data;
+}
+
+/*
+ * Runs the command with stdout or stderr (captureFd) going to a pipe, returning what it wrote along with the wall
+ * time and the peak resident set size of the child.
+ */
+static RunResult
+runCommand(char **argv, int captureFd) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        fatal("Could not create a pipe\n");
+    }
+
+    double start = getSeconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fatal("Could not fork\n");
+    }
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, captureFd == STDOUT_FILENO ? STDERR_FILENO : STDOUT_FILENO);
+        dup2(pipeFds[1], captureFd);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    close(pipeFds[1]);
+    RunResult result = {};
+    result.capturedOutput = readAll(pipeFds[0]);
+    close(pipeFds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fatal("%s failed:\n%s", argv[0], result.capturedOutput);
+    }
+    result.wallSeconds = getSeconds() - start;
+    result.peakRssKilobytes = usage.ru_maxrss;
+    return result;
+}
+
+static double
+parseStatSeconds(const char *stats, const char *label) {
+    const char *at = strstr(stats, label);
+    if (!at) {
+        fatal("Missing \"%s\" in the --stats output:\n%s", label, stats);
+    }
+    return strtod(at + strlen(label), nullptr);
+}
+
+static void
+printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [--metatool <path>] [--structs <n>] [--members <n>] [--enums <n>] [--enum-size <n>] "
+                    "[--enum-sparsity <n>] [--comments <percent>] [--strings <percent>] [--runs <n>] [--seed <n>] "
+                    "[--corpus <output.cpp>]\n", program);
+    exit(1);
+}
+
+int
+main(int argc, char **argv) {
+    Config config = {};
+    config.structCount = 1000;
+    config.memberCount = 16;
+    config.enumCount = 100;
+    config.enumSize = 32;
+    config.enumSparsity = 1;
+    config.commentDensity = 20;
+    config.stringDensity = 20;
+    config.runs = 5;
+    config.seed = 1;
+
+    const char *metatool = "build/metatool";
+    const char *corpusOnly = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+        }
+        const char *value = argv[++i];
+
+        if (!strcmp(arg, "--metatool")) metatool = value;
+        else if (!strcmp(arg, "--corpus")) corpusOnly = value;
+        else if (!strcmp(arg, "--structs")) config.structCount = atoi(value);
+        else if (!strcmp(arg, "--members")) config.memberCount = atoi(value);
+        else if (!strcmp(arg, "--enums")) config.enumCount = atoi(value);
+        else if (!strcmp(arg, "--enum-size")) config.enumSize = atoi(value);
+        else if (!strcmp(arg, "--enum-sparsity")) config.enumSparsity = atoi(value);
+        else if (!strcmp(arg, "--comments")) config.commentDensity = atoi(value);
+        else if (!strcmp(arg, "--strings")) config.stringDensity = atoi(value);
+        else if (!strcmp(arg, "--runs")) config.runs = atoi(value);
+        else if (!strcmp(arg, "--seed")) config.seed = strtoull(value, nullptr, 10);
+        else printUsage(argv[0]);
+    }
+
+    if (config.runs < 1 || config.enumSparsity < 1 || config.memberCount < 1) {
+        printUsage(argv[0]);
+    }
+
+    if (corpusOnly) {
+        FILE *file = fopen(corpusOnly, "w");
+        if (!file) {
+            fatal("Could not open %s for writing\n", corpusOnly);
+        }
+        generateCorpus(&config, file);
+        fclose(file);
+        return 0;
+    }
+
+    char directory[] = "/tmp/metatool-bench-XXXXXX";
+    if (!mkdtemp(directory)) {
+        fatal("Could not create a temporary directory\n");
+    }
+    char corpusName[64];
+    char outputName[64];
+    snprintf(corpusName, sizeof(corpusName), "%s/corpus.cpp", directory);
+    snprintf(outputName, sizeof(outputName), "%s/meta_generated.h", directory);
+
+    FILE *corpus = fopen(corpusName, "w");
+    if (!corpus) {
+        fatal("Could not open %s for writing\n", corpusName);
+    }
+    generateCorpus(&config, corpus);
+    fclose(corpus);
+
+    struct stat corpusStat;
+    stat(corpusName, &corpusStat);
+
+    // Best of several runs, the minimum is the least noisy estimate of what the code itself costs. --stats does extra
+    // work of its own, so the wall time and memory come from separate runs without it.
+    double wallSeconds = 0, parseSeconds = 0, generateSeconds = 0;
+    long peakRssKilobytes = 0;
+    for (int run = 0; run < config.runs; run++) {
+        char *args[] = { (char *)metatool, (char *)"-o", outputName, corpusName, nullptr };
+        RunResult result = runCommand(args, STDERR_FILENO);
+        if (run == 0 || result.wallSeconds < wallSeconds) wallSeconds = result.wallSeconds;
+        if (result.peakRssKilobytes > peakRssKilobytes) peakRssKilobytes = result.peakRssKilobytes;
+        free(result.capturedOutput);
+
+        char *statsArgs[] = { (char *)metatool, (char *)"--stats-json", (char *)"-o", outputName, corpusName, nullptr };
+        result = runCommand(statsArgs, STDERR_FILENO);
+        double parse = parseStatSeconds(result.capturedOutput, "\"parse_wall_seconds\":");
+        double generate = parseStatSeconds(result.capturedOutput, "\"emit_seconds\":");
+        if (run == 0 || parse < parseSeconds) parseSeconds = parse;
+        if (run == 0 || generate < generateSeconds) generateSeconds = generate;
+        free(result.capturedOutput);
+    }
+
+    struct stat outputStat;
+    stat(outputName, &outputStat);
+
+    printf("{\"benchmark\":\"metatool\",\"structs\":%d,\"members\":%d,\"enums\":%d,\"enum_size\":%d,"
+           "\"enum_sparsity\":%d,\"comments\":%d,\"strings\":%d,\"seed\":%llu,\"input_bytes\":%lld,"
+           "\"output_bytes\":%lld,\"wall_seconds\":%.6f,\"parse_seconds\":%.6f,\"generate_seconds\":%.6f,"
+           "\"peak_rss_kb\":%ld",
+           config.structCount, config.memberCount, config.enumCount, config.enumSize, config.enumSparsity,
+           config.commentDensity, config.stringDensity, (unsigned long long)config.seed,
+           (long long)corpusStat.st_size, (long long)outputStat.st_size, wallSeconds, parseSeconds, generateSeconds,
+           peakRssKilobytes);
+
+    // One line per scanner after the header: name, tokens, seconds, MB/s and skip scan MB/s
+    char *args[] = { (char *)metatool, (char *)"--benchmark-tokenizer", corpusName, nullptr };
+    RunResult tokenizer = runCommand(args, STDOUT_FILENO);
+    const char *header = strchr(tokenizer.capturedOutput, '\n');
+    for (int column = 0; column < 2; column++) {
+        printf(column ? ",\"skip_scan_mb_s\":{" : ",\"tokenizer_mb_s\":{");
+        bool first = true;
+        for (const char *line = header; line && line[1]; line = strchr(line + 1, '\n')) {
+            char scanner[16];
+            int tokens;
+            double seconds, megabytesPerSecond[2];
+            if (sscanf(line + 1, "%15s %d %lf %lf %lf", scanner, &tokens, &seconds, &megabytesPerSecond[0], 
+                       &megabytesPerSecond[1]) != 5) continue;
+            printf("%s\"%s\":%.1f", first ? "" : ",", scanner, megabytesPerSecond[column]);
+            first = false;
+        }
+        printf("}");
+    }
+    printf("}\n");
+    free(tokenizer.capturedOutput);
+
+    unlink(outputName);
+    unlink(corpusName);
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# Builds an optimised metatool and the benchmarks, then runs them over a range of corpus sizes. Every result is one
+# JSON object per line on stdout, so the output of two revisions can be compared directly.
+
+set -e
+
+compiler=${CC:-clang}
+cppflags="-O3 --std=c++17 -Wall -Wextra -Werror -Wno-unused-parameter -Wno-unused-function -fno-exceptions -fno-rtti"
+
+src_dir="src"
+bench_dir="bench"
+build_dir="build/bench"
+
+if ! [ -e ${build_dir} ]; then
+	mkdir -p ${build_dir}
+fi
+
+${compiler} ${cppflags} -pthread -o ${build_dir}/metatool ${src_dir}/metatool.cpp
+${compiler} ${cppflags} -o ${build_dir}/bench ${bench_dir}/bench.cpp
+
+${build_dir}/metatool -o ${build_dir}/meta_generated.h ${bench_dir}/runtime_types.h
+${compiler} ${cppflags} -I ${build_dir} -o ${build_dir}/runtime ${bench_dir}/runtime.cpp
+
+# Scale, then members per struct, then enum sparsity, then comment and string heavy input
+for structs in 100 1000 10000; do
+	${build_dir}/bench --metatool ${build_dir}/metatool --structs ${structs} --enums $((structs / 10)) "$@"
+done
+for members in 4 64; do
+	${build_dir}/bench --metatool ${build_dir}/metatool --members ${members} "$@"
+done
+${build_dir}/bench --metatool ${build_dir}/metatool --enum-size 256 --enum-sparsity 1000 "$@"
+${build_dir}/bench --metatool ${build_dir}/metatool --comments 100 --strings 100 "$@"
+
+${build_dir}/runtime
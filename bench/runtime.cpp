@@ -0,0 +1,158 @@
+/*
+ * Measures the runtime cost of the generated API on the types in runtime_types.h, printing one JSON object per
+ * benchmark. Build it against the output of the metatool being measured:
+ *
+ *     metatool -o meta_generated.h bench/runtime_types.h
+ *     clang -O2 -I . bench/runtime.cpp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "runtime_types.h"
+#include "meta_generated.h"
+
+#define ENTITY_COUNT 1024
+#define LOOKUP_COUNT 4096
+
+// Stores results here so the compiler can't throw the work away
+static volatile uint64_t sink;
+
+static double
+getSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Repeats the benchmark for at least a quarter of a second after one warm up pass and reports nanoseconds per
+ * operation, where each call to benchmark does operationCount operations.
+ */
+template <typename Benchmark>
+static void
+runBenchmark(const char *name, int operationCount, Benchmark benchmark) {
+    benchmark();
+
+    int iterations = 0;
+    double start = getSeconds();
+    double elapsed = 0;
+    do {
+        benchmark();
+        iterations++;
+        elapsed = getSeconds() - start;
+    } while (elapsed < 0.25);
+
+    printf("{\"benchmark\":\"%s\",\"operations\":%lld,\"ns_per_op\":%.3f}\n", name,
+           (long long)iterations * operationCount, elapsed * 1e9 / ((double)iterations * operationCount));
+}
+
+static void
+addValue(uint64_t *sum, const char *value) {
+    *sum += value ? (unsigned char)value[0] : 0;
+}
+
+template <typename T>
+static void
+addValue(uint64_t *sum, const T &value) {
+    *sum += (uint64_t)value;
+}
+
+template <typename T, size_t N>
+static void
+addValue(uint64_t *sum, const T (&value)[N]) {
+    for (size_t i = 0; i < N; i++) *sum += (uint64_t)value[i];
+}
+
+int
+main() {
+    // Lookups are in a shuffled order so the branch predictor can't learn the sequence
+    static DenseEnum denseValues[LOOKUP_COUNT];
+    static SparseEnum sparseValues[LOOKUP_COUNT];
+    Meta_EnumMember *denseMembers = meta_getMembers(DenseEnum_00);
+    Meta_EnumMember *sparseMembers = meta_getMembers(SparseEnum_00);
+    int denseCount = meta_get(DenseEnum_00)->memberCount;
+    int sparseCount = meta_get(SparseEnum_00)->memberCount;
+    uint32_t random = 1;
+    for (int i = 0; i < LOOKUP_COUNT; i++) {
+        random = random * 1664525 + 1013904223;
+        denseValues[i] = (DenseEnum)denseMembers[(random >> 8) % denseCount].value;
+        sparseValues[i] = (SparseEnum)sparseMembers[(random >> 8) % sparseCount].value;
+    }
+
+    static BenchEntity entities[ENTITY_COUNT];
+    for (int i = 0; i < ENTITY_COUNT; i++) {
+        BenchEntity *e = entities + i;
+        e->id = i;
+        e->health = (float)(i % 100);
+        e->weight = i * 0.5;
+        e->flags = i * 7;
+        e->timestamp = i * 1000;
+        e->scale[0] = e->scale[1] = e->scale[2] = 1;
+        e->name = (char *)"entity";
+        e->team = (uint8_t)(i % 4);
+        e->level = (uint16_t)(i % 60);
+        e->state = denseValues[i];
+        e->score = i * 3;
+        e->speed = 2;
+    }
+
+    runBenchmark("meta_getName_dense", LOOKUP_COUNT, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < LOOKUP_COUNT; i++) addValue(&sum, meta_getName(denseValues[i]));
+        sink = sum;
+    });
+
+    runBenchmark("meta_getName_sparse", LOOKUP_COUNT, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < LOOKUP_COUNT; i++) addValue(&sum, meta_getName(sparseValues[i]));
+        sink = sum;
+    });
+
+    // One operation is one member visited, so the runtime and compile time iteration are directly comparable
+    int memberCount = meta_get(entities)->memberCount;
+
+    runBenchmark("meta_getMemberPtr", ENTITY_COUNT * memberCount, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < ENTITY_COUNT; i++) {
+            BenchEntity &e = entities[i];
+            Meta_StructMember *members = meta_getMembers(&e);
+            for (int m = 0; m < memberCount; m++) {
+                Meta_StructMember *member = members + m;
+                void *memberPointer = meta_getMemberPtr(e, member);
+                int count = meta_isArray(member) ? member->arraySize : 1;
+                for (int k = 0; k < count; k++) {
+                    switch (member->type) {
+                        case Meta_Type_int: sum += ((int *)memberPointer)[k]; break;
+                        case Meta_Type_float: sum += (uint64_t)((float *)memberPointer)[k]; break;
+                        case Meta_Type_double: sum += (uint64_t)((double *)memberPointer)[k]; break;
+                        case Meta_Type_uint32_t: sum += ((uint32_t *)memberPointer)[k]; break;
+                        case Meta_Type_int64_t: sum += ((int64_t *)memberPointer)[k]; break;
+                        case Meta_Type_uint8_t: sum += ((uint8_t *)memberPointer)[k]; break;
+                        case Meta_Type_uint16_t: sum += ((uint16_t *)memberPointer)[k]; break;
+                        case Meta_Type_int32_t: sum += ((int32_t *)memberPointer)[k]; break;
+                        case Meta_Type_DenseEnum: sum += ((DenseEnum *)memberPointer)[k]; break;
+                        case Meta_Type_char: addValue(&sum, ((char **)memberPointer)[k]); break;
+                        default: break;
+                    }
+                }
+            }
+        }
+        sink = sum;
+    });
+
+    runBenchmark("meta_forEachMember", ENTITY_COUNT * memberCount, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < ENTITY_COUNT; i++) {
+            meta_forEachMember(entities[i], [&](auto &field, auto &value) {
+                addValue(&sum, value);
+            });
+        }
+        sink = sum;
+    });
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Fixed types for the runtime benchmark, so its numbers stay comparable between revisions.
+ */
+
+#include <stdint.h>
+
+#define Introspect(...)
+
+Introspect()
+enum DenseEnum {
+    DenseEnum_00, DenseEnum_01, DenseEnum_02, DenseEnum_03, DenseEnum_04, DenseEnum_05, DenseEnum_06, DenseEnum_07,
+    DenseEnum_08, DenseEnum_09, DenseEnum_10, DenseEnum_11, DenseEnum_12, DenseEnum_13, DenseEnum_14, DenseEnum_15,
+    DenseEnum_16, DenseEnum_17, DenseEnum_18, DenseEnum_19, DenseEnum_20, DenseEnum_21, DenseEnum_22, DenseEnum_23,
+    DenseEnum_24, DenseEnum_25, DenseEnum_26, DenseEnum_27, DenseEnum_28, DenseEnum_29, DenseEnum_30, DenseEnum_31,
+};
+
+Introspect()
+enum SparseEnum {
+    SparseEnum_00 = 3,      SparseEnum_01 = 17,     SparseEnum_02 = 250,    SparseEnum_03 = 1001,
+    SparseEnum_04 = 1024,   SparseEnum_05 = 4097,   SparseEnum_06 = 9000,   SparseEnum_07 = 12345,
+    SparseEnum_08 = 20000,  SparseEnum_09 = 31337,  SparseEnum_10 = 40000,  SparseEnum_11 = 65535,
+    SparseEnum_12 = 65536,  SparseEnum_13 = 70001,  SparseEnum_14 = 99999,  SparseEnum_15 = 100000,
+    SparseEnum_16 = 123456, SparseEnum_17 = 200003, SparseEnum_18 = 250000, SparseEnum_19 = 300007,
+    SparseEnum_20 = 400009, SparseEnum_21 = 500000, SparseEnum_22 = 655360, SparseEnum_23 = 700001,
+    SparseEnum_24 = 800011, SparseEnum_25 = 900000, SparseEnum_26 = 999999, SparseEnum_27 = 1000003,
+    SparseEnum_28 = 2000000, SparseEnum_29 = 4000037, SparseEnum_30 = 8000000, SparseEnum_31 = 16000057,
+};
+
+Introspect()
+struct BenchEntity {
+    int id;
+    float health;
+    double weight;
+    uint32_t flags;
+    int64_t timestamp;
+    float scale[3];
+    char *name;
+    uint8_t team;
+    uint16_t level;
+    DenseEnum state;
+    int32_t score;
+    float speed;
+};
@@ -8,10 +8,12 @@ mode="debug"
 disabled_warnings="-Wno-unused-parameter -Wno-unused-function"
 
 cppflags="--std=c++17 -Wall -Wextra -Werror ${disabled_warnings} -fno-exceptions -fno-rtti"
+cppflags_test="--std=c++17 -Wall -Wextra -Werror -fno-exceptions -fno-rtti"
 cppflags_debug="-O0 -g"
 cppflags_optimised="-O3"
 
 src_dir="src"
+test_dir="tests"
 build_dir="build"
 
 if ! [ -e ${build_dir} ]; then
@@ -20,20 +22,78 @@ fi
 
 if [ "${mode}" = "debug" ]; then
 	cppflags="${cppflags_debug} ${cppflags}"
+	cppflags_test="${cppflags_debug} ${cppflags_test}"
 elif [ "${mode}" = "optimised" ]; then
 	cppflags="${cppflags_optimised} ${cppflags}"
+	cppflags_test="${cppflags_optimised} ${cppflags_test}"
 else
 	echo "Unknown mode ${mode}"
 	exit -1
 fi
 
 time (
-	clang ${cppflags} -o ${build_dir}/metatool ${src_dir}/metatool.cpp
+	clang ${cppflags} -pthread -o ${build_dir}/metatool ${src_dir}/metatool.cpp
 
-	# Build test
-	# ${build_dir}/metatool ${src_dir}/test.cpp > ${src_dir}/meta_generated.h
-	# clang ${cppflags} -o ${build_dir}/test ${src_dir}/test.cpp
+	# Build the test of the generated code, once with each kind of table and once split into a header per input. The
+	# generated code has to compile without any of the disabled warnings.
+	for variant in default const_tables split; do
+		mkdir -p ${build_dir}/${variant}
+		options="--serialize --json --hash --delta --registry"
+		inputs="${test_dir}/test_common.h ${test_dir}/test_types.h"
+		sources="${test_dir}/test.cpp"
+		if [ "${variant}" = "const_tables" ]; then
+			options="${options} --const-tables"
+		fi
+		if [ "${variant}" = "split" ]; then
+			# Only include the header for test_types.h, it has to bring in the one for test_common.h itself. With
+			# --split-source the registry header doesn't include every input's header, which would hide it if not.
+			${build_dir}/metatool ${options} --split ${build_dir}/split --split-source ${build_dir}/split/meta.cpp ${inputs}
+			printf '#include "meta_registry.h"\n#include "test_types.meta.h"\n' > ${build_dir}/split/meta_generated.h
+			sources="${sources} ${build_dir}/split/meta.cpp"
+		else
+			${build_dir}/metatool ${options} -o ${build_dir}/${variant}/meta_generated.h ${inputs}
+		fi
+		clang ${cppflags_test} -I. -I${test_dir} -I${build_dir}/${variant} -o ${build_dir}/${variant}/test ${sources}
+	done
 )
 
 # Run the test
-# ${build_dir}/test
+for variant in default const_tables split; do
+	echo "Testing ${variant} tables"
+	${build_dir}/${variant}/test
+done
+
+# A cache with an entry count the file can't hold is ignored and rebuilt
+echo "Testing a corrupt cache"
+cache=${build_dir}/test.cache
+rm -f ${cache}
+${build_dir}/metatool --cache ${cache} ${test_dir}/test_types.h > /dev/null
+printf '\377\377\377\177' | dd of=${cache} bs=1 seek=8 conv=notrunc 2> /dev/null
+${build_dir}/metatool --cache ${cache} ${test_dir}/test_types.h 2>&1 > /dev/null | grep -q "Ignoring corrupt cache"
+${build_dir}/metatool --cache ${cache} ${test_dir}/test_types.h > /dev/null
+rm ${cache}
+echo "All checks passed"
+
+# Inputs of up to INT_MAX bytes are split into chunks without losing any definitions, anything bigger is refused.
+# The padding is sparse, so this needs next to no disk space.
+echo "Testing large inputs"
+large_input=${build_dir}/large_input.h
+printf 'Introspect() struct Head { int a; };\n' > ${large_input}
+truncate -s 1500000000 ${large_input}
+printf '\nIntrospect() struct Middle { int a; };\n' >> ${large_input}
+truncate -s $((2147483647 - 37)) ${large_input}
+printf '\nIntrospect() struct Tail { int a; };' >> ${large_input}
+for threads in 1 8; do
+	found=$(${build_dir}/metatool -j ${threads} ${large_input} | grep -c "^Meta_Struct meta_\(Head\|Middle\|Tail\) =")
+	if [ "${found}" != "3" ]; then
+		echo "Only ${found} of 3 structs found in a 2 GB input with ${threads} threads"
+		exit 1
+	fi
+done
+printf ' ' >> ${large_input}
+if ${build_dir}/metatool -j 8 ${large_input} > /dev/null 2>&1; then
+	echo "An input over INT_MAX bytes was accepted"
+	exit 1
+fi
+rm ${large_input}
+echo "All checks passed"
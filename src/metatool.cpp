@@ -1,7 +1,34 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
 #include <memory.h>
+#include <setjmp.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#endif
+
+#ifdef __APPLE__
+#define statModifiedNanoseconds(s) ((s).st_mtimespec.tv_nsec)
+#else
+#define statModifiedNanoseconds(s) ((s).st_mtim.tv_nsec)
+#endif
 
 /*
  * Globals
@@ -13,52 +40,324 @@ static const char *keyword_enum = "enum";
 
 static bool printAllTokens = false;
 static bool generateOutput = true;
+static bool printStats = false;
+static bool printStatsJson = false;
+static bool generateSerializers = false;
+static bool generateJson = false;
+static bool generateHash = false;
+static bool generateDelta = false;
+static bool generateRegistry = false;
+// Emit every table as constexpr data with names as offsets into one string pool, see StringPool
+static bool constTables = false;
+// Only tokenize the definitions after Introspect markers, scanning past everything else
+static bool skipScan = true;
+// Set while --watch is reparsing and regenerating, so an error in one edit doesn't take the whole daemon down
+static jmp_buf *fatalJump = nullptr;
+
+/*
+ * A large input is parsed in chunks on several threads, see parseChunks. A chunk may start in the middle of a comment
+ * or literal, so until it's known which part of it agrees with a parse from the start of the file, its warnings and
+ * errors are collected here rather than reported. Each is tagged with the last rest point the parser passed.
+ */
+struct Diagnostic {
+    int offset;
+    bool isFatal;
+    char *message;
+    Diagnostic *next;
+};
+
+struct ChunkSync {
+    // Parsing stops at the first rest point at or past this
+    int limit;
+    // Rest points before this are kept, for checking against where the previous chunk stopped
+    int windowEnd;
+    int *restPoints;
+    int restPointCount;
+    int restPointCapacity;
+    int lastRestPoint;
+    // Most recent first
+    Diagnostic *firstDiagnostic;
+    jmp_buf jump;
+};
+
+static thread_local ChunkSync *chunkSync = nullptr;
 
 /*
  * Utility
  */
 
 #define arrayLength(a) (int)(sizeof(a) / sizeof(a[0]))
-#define allocStruct(type) (type *)calloc(1, sizeof(type))
+
+static double
+getSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void
+logDiagnostic(bool isFatal, const char *format, va_list args) {
+    va_list sizeArgs;
+    va_copy(sizeArgs, args);
+    int length = vsnprintf(nullptr, 0, format, sizeArgs);
+    va_end(sizeArgs);
+
+    Diagnostic *diagnostic = (Diagnostic *)calloc(1, sizeof(Diagnostic));
+    diagnostic->offset = chunkSync->lastRestPoint;
+    diagnostic->isFatal = isFatal;
+    diagnostic->message = (char *)malloc(length + 1);
+    vsnprintf(diagnostic->message, length + 1, format, args);
+
+    diagnostic->next = chunkSync->firstDiagnostic;
+    chunkSync->firstDiagnostic = diagnostic;
+}
 
 static void
 warn(const char* format, ...)
 {
+    if (chunkSync) {
+        va_list args;
+        va_start(args, format);
+        logDiagnostic(false, format, args);
+        va_end(args);
+        return;
+    }
+
     fprintf(stderr, "[WARN] ");
     va_list args;
     va_start(args, format);
-    vfprintf(stdout, format, args);
+    vfprintf(stderr, format, args);
     va_end(args);
 }
 
 static void 
 fatal(const char* format, ...)
 {
-    fprintf(stderr, "[FATAL] ");
+    if (chunkSync) {
+        va_list args;
+        va_start(args, format);
+        logDiagnostic(true, format, args);
+        va_end(args);
+        longjmp(chunkSync->jump, 1);
+    }
+
+    fprintf(stderr, fatalJump ? "[ERROR] " : "[FATAL] ");
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
     va_end(args);
+    if (fatalJump) longjmp(*fatalJump, 1);
     exit(-1);
 }
 
-static char* 
-readFileToString(const char* fileName)
-{
-    FILE* file = fopen(fileName, "r");
-    if (!file)
+/*
+ * Memory
+ *
+ * Everything the parser produces lives in an arena and is released all at once. Blocks double in size as the arena
+ * grows, so even a huge input only ever needs a handful of system allocations.
+ */
+
+struct AllocationStats {
+    uint64_t pushCount;
+    uint64_t pushBytes;
+    uint64_t systemCount;
+    uint64_t systemBytes;
+};
+
+static AllocationStats allocationStats = {};
+
+struct ArenaBlock {
+    ArenaBlock *prev;
+    size_t size;
+    size_t used;
+};
+
+struct Arena {
+    ArenaBlock *current;
+};
+
+static const size_t arenaMinimumBlockSize = 1024 * 1024;
+
+#define pushStruct(arena, type) (type *)arenaPush(arena, sizeof(type), alignof(type))
+
+/*
+ * Returns zeroed memory.
+ */
+static void *
+arenaPush(Arena *arena, size_t size, size_t alignment = 8) {
+    ArenaBlock *block = arena->current;
+    size_t offset = 0;
+
+    if (block) {
+        offset = (sizeof(ArenaBlock) + block->used + alignment - 1) & ~(alignment - 1);
+    }
+
+    if (!block || offset + size > block->size) {
+        size_t blockSize = block ? block->size * 2 : arenaMinimumBlockSize;
+        while (blockSize < sizeof(ArenaBlock) + size + alignment) blockSize *= 2;
+
+        ArenaBlock *newBlock = (ArenaBlock *)calloc(1, blockSize);
+        if (!newBlock) 
+            fatal("Out of memory allocating %zu bytes\n", blockSize);
+
+        newBlock->prev = block;
+        newBlock->size = blockSize;
+        arena->current = block = newBlock;
+
+        __atomic_fetch_add(&allocationStats.systemCount, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&allocationStats.systemBytes, blockSize, __ATOMIC_RELAXED);
+
+        offset = (sizeof(ArenaBlock) + alignment - 1) & ~(alignment - 1);
+    }
+
+    block->used = offset + size - sizeof(ArenaBlock);
+
+    __atomic_fetch_add(&allocationStats.pushCount, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocationStats.pushBytes, size, __ATOMIC_RELAXED);
+
+    return (char *)block + offset;
+}
+
+/*
+ * Moves every block of other into arena, leaving other empty.
+ */
+static void
+arenaAppend(Arena *arena, Arena *other) {
+    if (!other->current) return;
+
+    ArenaBlock *oldest = other->current;
+    while (oldest->prev) oldest = oldest->prev;
+    oldest->prev = arena->current;
+
+    arena->current = other->current;
+    other->current = nullptr;
+}
+
+static void
+arenaFree(Arena *arena) {
+    ArenaBlock *block = arena->current;
+    while (block) {
+        ArenaBlock *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    arena->current = nullptr;
+}
+
+/*
+ * File names and anything else that outlives a single input.
+ */
+static Arena globalArena = {};
+
+struct FileData {
+    const char *data;
+    size_t size;
+    bool isMapped;
+};
+
+/*
+ * Reads from a descriptor that can't be mapped (pipes, stdin, character devices) by growing a buffer until EOF.
+ */
+static FileData
+readFileStream(int fd, const char *fileName) {
+    FileData result = {};
+
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char *buffer = (char *)malloc(capacity);
+
+    for (;;) {
+        if (size == capacity) {
+            capacity *= 2;
+            buffer = (char *)realloc(buffer, capacity);
+        }
+
+        ssize_t bytesRead = read(fd, buffer + size, capacity - size);
+        if (bytesRead < 0) {
+            fatal("Could not read from %s\n", fileName);
+        }
+        if (bytesRead == 0) break;
+
+        size += bytesRead;
+    }
+
+    result.data = buffer;
+    result.size = size;
+    return result;
+}
+
+// --watch needs the previous contents of an input to compare against, which a mapping changed in place wouldn't keep
+static bool copyInputs = false;
+
+/*
+ * Maps the whole file read-only so tokens can point straight into the page cache. The data is NOT null terminated,
+ * everything downstream is bounded by the size instead.
+ */
+static FileData
+mapFile(const char *fileName) {
+    FileData result = {};
+
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
         fatal("Could not open %s for reading\n", fileName);
 
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+        fatal("Could not stat %s\n", fileName);
+
+    if (S_ISREG(fileStat.st_mode) && !copyInputs) {
+        result.size = fileStat.st_size;
+
+        if (result.size > 0) {
+            void *mapping = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, result.size, MADV_SEQUENTIAL);
+                result.data = (const char *)mapping;
+                result.isMapped = true;
+            } else {
+                result = readFileStream(fd, fileName);
+            }
+        }
+    } else {
+        result = readFileStream(fd, fileName);
+    }
+
+    close(fd);
+
+    return result;
+}
+
+static void
+closeFile(FileData *file) {
+    if (file->isMapped) {
+        munmap((void *)file->data, file->size);
+    } else {
+        free((void *)file->data);
+    }
+    *file = {};
+}
+
+/*
+ * Opens a file, or stdin for a file name of "-". Token offsets, positions and chunk limits are ints, so anything over
+ * INT_MAX bytes is refused here rather than parsed wrongly.
+ */
+static FileData
+openFile(const char *fileName) {
+    FileData result = {};
 
-    char* fileString = (char*)malloc(size + 1);
-    fread(fileString, size, 1, file);
+    if (strcmp(fileName, "-") == 0) {
+        fileName = "<stdin>";
+        result = readFileStream(STDIN_FILENO, fileName);
+    } else {
+        result = mapFile(fileName);
+    }
 
-    fileString[size] = 0;
+    if (result.size > INT_MAX) {
+        closeFile(&result);
+        fatal("%s is too large, files can be at most %d bytes\n", fileName, INT_MAX);
+    }
 
-    return fileString;
+    return result;
 }
 
 static inline bool 
@@ -82,10 +381,10 @@ isDigit(char c) {
 }
 
 static uint64_t 
-fnv1_hash(const char *str, int length) {
+fnv1_hash(const char *str, size_t length) {
    uint64_t hash = 0xcbf29ce484222325;
 
-   for (int i = 0; i < length; i++) {
+   for (size_t i = 0; i < length; i++) {
        hash *= 0x100000001b3;
        hash ^= str[i];
    }
@@ -95,42 +394,208 @@ fnv1_hash(const char *str, int length) {
 
 struct String {
     int length;
-    char *data;
+    const char *data;
 };
 
+/*
+ * String interning. Open addressing with linear probing over a power of two slot array which doubles whenever it
+ * gets half full. Entries live in a separate array in insertion order, their index is the interned ID and never
+ * changes, even across a resize.
+ */
+
 struct StringHashEntry {
-    uint64_t key;
+    uint64_t hash;
     String value;
-    StringHashEntry *next;
 };
 
-static StringHashEntry *stringHash[1024] = {};
+struct StringHashSlot {
+    // The low bits of the hash, so most mismatches never touch the entry
+    uint32_t hash;
+    // Index into entries plus one, zero means the slot is empty
+    uint32_t entry;
+};
+
+struct StringHash {
+    StringHashSlot *slots;
+    int slotCount;
+
+    StringHashEntry *entries;
+    int count;
+    int capacity;
+
+    // Holds the interned copies, so freeing the table frees them too
+    Arena arena;
+};
+
+static StringHash stringHash = {};
+// Names of every introspected struct and enum, so generators can tell them apart from other member types
+static StringHash structNames = {};
+static StringHash enumNames = {};
+// Every Introspect option used by any input, so shared definitions are only emitted when something needs them
+static uint32_t usedIntrospectOptions = 0;
+
+/*
+ * With --const-tables the generated tables hold no pointers, as each one needs a relocation when the program is
+ * loaded, which keeps the tables out of shared read only pages. Names are offsets into meta_strings instead, which
+ * holds every distinct name once. Offset 0 is the empty string.
+ */
+struct StringPool {
+    StringHash names;
+    // Indexed by the name's ID in names
+    uint32_t *offsets;
+    int offsetCapacity;
+    uint32_t size;
+};
+
+static StringPool stringPool = {};
+
+static inline int
+stringHashSlotIndex(StringHash *table, uint64_t hash) {
+    // FNV-1's low bits are weak on their own, so fold the top half in
+    return (int)((hash ^ (hash >> 32)) & (table->slotCount - 1));
+}
 
 static void
-stringHashPut(String *str) {
-    uint64_t hash = fnv1_hash(str->data, str->length);
-    int bucketIndex = hash % 1024;
+stringHashGrow(StringHash *table) {
+    free(table->slots);
 
-    bool bucketNotEmpty = stringHash[bucketIndex] != nullptr;
+    table->slotCount = table->slotCount ? table->slotCount * 2 : 1024;
+    table->slots = (StringHashSlot *)calloc(table->slotCount, sizeof(StringHashSlot));
 
-    if (bucketNotEmpty) {
-        for (StringHashEntry *entry = stringHash[bucketIndex]; entry; entry = entry->next) {
-            if (entry->key == hash) return;
+    for (int i = 0; i < table->count; i++) {
+        uint64_t hash = table->entries[i].hash;
+        int index = stringHashSlotIndex(table, hash);
+        while (table->slots[index].entry) {
+            index = (index + 1) & (table->slotCount - 1);
         }
-    } 
-        
-    StringHashEntry *newEntry = allocStruct(StringHashEntry);
-    newEntry->key = hash;
-    newEntry->value.length = str->length;
-    newEntry->value.data = (char *)malloc(str->length);
-    memcpy(newEntry->value.data, str->data, str->length);
-
-    if (bucketNotEmpty) {
-        newEntry->next = stringHash[bucketIndex];
-        stringHash[bucketIndex] = newEntry;
-    } else {
-        stringHash[bucketIndex] = newEntry;
+        table->slots[index].hash = (uint32_t)hash;
+        table->slots[index].entry = i + 1;
+    }
+}
+
+/*
+ * Returns the slot holding the string, or the empty slot where it would go.
+ */
+static StringHashSlot *
+stringHashFindSlot(StringHash *table, String *str, uint64_t hash) {
+    int index = stringHashSlotIndex(table, hash);
+
+    for (;;) {
+        StringHashSlot *slot = table->slots + index;
+        if (!slot->entry) return slot;
+
+        if (slot->hash == (uint32_t)hash) {
+            StringHashEntry *entry = table->entries + slot->entry - 1;
+            if (entry->hash == hash && entry->value.length == str->length && 
+                    memcmp(entry->value.data, str->data, str->length) == 0) {
+                return slot;
+            }
+        }
+
+        index = (index + 1) & (table->slotCount - 1);
+    }
+}
+
+/*
+ * Returns the ID of the string, or -1 if it hasn't been interned.
+ */
+static int
+stringHashFind(StringHash *table, String *str) {
+    if (!table->slotCount) return -1;
+    StringHashSlot *slot = stringHashFindSlot(table, str, fnv1_hash(str->data, str->length));
+    return (int)slot->entry - 1;
+}
+
+/*
+ * Interns a copy of the string if it hasn't been seen before, and returns its ID either way.
+ */
+static int
+stringHashPut(StringHash *table, String *str) {
+    if ((table->count + 1) * 2 > table->slotCount) {
+        stringHashGrow(table);
+    }
+
+    uint64_t hash = fnv1_hash(str->data, str->length);
+    StringHashSlot *slot = stringHashFindSlot(table, str, hash);
+    if (slot->entry) {
+        return slot->entry - 1;
+    }
+
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 1024;
+        table->entries = (StringHashEntry *)realloc(table->entries, table->capacity * sizeof(StringHashEntry));
+    }
+
+    int id = table->count++;
+
+    char *data = (char *)arenaPush(&table->arena, str->length, 1);
+    memcpy(data, str->data, str->length);
+
+    StringHashEntry *entry = table->entries + id;
+    entry->hash = hash;
+    entry->value.length = str->length;
+    entry->value.data = data;
+
+    slot->hash = (uint32_t)hash;
+    slot->entry = id + 1;
+
+    return id;
+}
+
+/*
+ * How far entries ended up from the slot their hash maps to, for --stats.
+ */
+static void
+stringHashProbeLengths(StringHash *table, int *longest, double *average) {
+    int64_t total = 0;
+    *longest = 0;
+
+    for (int index = 0; index < table->slotCount; index++) {
+        StringHashSlot *slot = table->slots + index;
+        if (!slot->entry) continue;
+
+        int home = stringHashSlotIndex(table, table->entries[slot->entry - 1].hash);
+        int distance = (index - home) & (table->slotCount - 1);
+        total += distance;
+        if (distance > *longest) *longest = distance;
+    }
+
+    *average = table->count ? (double)total / table->count : 0;
+}
+
+static void
+stringHashFree(StringHash *table) {
+    free(table->slots);
+    free(table->entries);
+    arenaFree(&table->arena);
+    *table = {};
+}
+
+static void
+stringPoolAdd(String *name) {
+    int count = stringPool.names.count;
+    int id = stringHashPut(&stringPool.names, name);
+    if (id < count) return;
+
+    if (id == stringPool.offsetCapacity) {
+        stringPool.offsetCapacity = stringPool.offsetCapacity ? stringPool.offsetCapacity * 2 : 1024;
+        stringPool.offsets = (uint32_t *)realloc(stringPool.offsets, stringPool.offsetCapacity * sizeof(uint32_t));
     }
+
+    stringPool.offsets[id] = stringPool.size;
+    stringPool.size += name->length + 1;
+}
+
+static uint32_t
+stringPoolOffset(String *name) {
+    return stringPool.offsets[stringHashFind(&stringPool.names, name)];
+}
+
+static void
+stringPoolFree() {
+    stringHashFree(&stringPool.names);
+    free(stringPool.offsets);
+    stringPool = {};
 }
 
 /*
@@ -152,152 +617,610 @@ reverse(T **first) {
 }
 
 /*
- * Tokenizer
+ * Scanner
+ *
+ * The tokenizer spends nearly all of its time skipping over runs of bytes: whitespace, identifiers, comment bodies
+ * and literals. These primitives do that skipping a block at a time using SSE2 or AVX2 when the CPU has it, falling
+ * back to plain byte loops everywhere else. Every function takes a [at, end) range, never reads outside it, and
+ * returns a pointer to the first byte that stops the scan (or end).
  */
 
-struct Tokenizer {
-    char* at;
-    int line;
-    int column;
-};
-
-enum TokenType {
-    TokenType_Unknown,
-
-    TokenType_LeftBrace,
-    TokenType_RightBrace,
-    TokenType_LeftParen,
-    TokenType_RightParen,
-    TokenType_LeftBracket,
-    TokenType_RightBracket,
-    TokenType_Slash,
-    TokenType_Asterisk,
-    TokenType_Semicolon,
-    TokenType_Colon,
-    TokenType_Pound,
-    TokenType_Equals,
-    TokenType_Period,
-    TokenType_Comma,
-    TokenType_LeftCaret,
-    TokenType_RightCaret,
-    TokenType_Plus,
-    TokenType_Minus,
-    TokenType_Not,
-    TokenType_And,
-    TokenType_Or,
-    TokenType_Tilde,
-    TokenType_Question,
-
-    TokenType_Identifier,
-    TokenType_String,
-    TokenType_Char,
-    TokenType_Number,
+enum ScannerKind {
+    ScannerKind_Auto,
+    ScannerKind_Scalar,
+    ScannerKind_SSE2,
+    ScannerKind_AVX2,
 
-    TokenType_End
+    ScannerKind_Count
 };
 
-const char *tokenTypeNames[] = {
-    [TokenType_Unknown] = "TokenType_Unknown",
+static const char *scannerKindNames[] = {
+    [ScannerKind_Auto] = "auto",
+    [ScannerKind_Scalar] = "scalar",
+    [ScannerKind_SSE2] = "sse2",
+    [ScannerKind_AVX2] = "avx2",
+};
 
-    [TokenType_LeftBrace] = "TokenType_LeftBrace",
-    [TokenType_RightBrace] = "TokenType_RightBrace",
-    [TokenType_LeftParen] = "TokenType_LeftParen",
-    [TokenType_RightParen] = "TokenType_RightParen",
-    [TokenType_LeftBracket] = "TokenType_LeftBracket",
-    [TokenType_RightBracket] = "TokenType_RightBracket",
-    [TokenType_Slash] = "TokenType_Slash",
-    [TokenType_Asterisk] = "TokenType_Asterisk",
-    [TokenType_Semicolon] = "TokenType_Semicolon",
-    [TokenType_Colon] = "TokenType_Colon",
-    [TokenType_Pound] = "TokenType_Pound",
-    [TokenType_Equals] = "TokenType_Equals",
-    [TokenType_Period] = "TokenType_Period",
-    [TokenType_Comma] = "TokenType_Comma",
-    [TokenType_LeftCaret] = "TokenType_LeftCaret",
-    [TokenType_RightCaret] = "TokenType_RightCaret",
-    [TokenType_Plus] = "TokenType_Plus",
-    [TokenType_Minus] = "TokenType_Minus",
-    [TokenType_Not] = "TokenType_Not",
-    [TokenType_And] = "TokenType_And",
-    [TokenType_Or] = "TokenType_Or",
-    [TokenType_Tilde] = "TokenType_Tilde",
-    [TokenType_Question] = "TokenType_Question",
+struct Scanner {
+    ScannerKind kind;
+
+    // Skips ' ', '\t', '\f', '\v', '\r' and '\n'
+    const char *(*skipWhitespace)(const char *at, const char *end);
+    // Skips [A-Za-z0-9_]
+    const char *(*skipIdentifier)(const char *at, const char *end);
+    // Finds the first occurrence of either a or b
+    const char *(*findEither)(const char *at, const char *end, char a, char b);
+    // Finds the first byte that could start a comment, literal or directive, or a first that has last lastOffset
+    // bytes after it, i.e. a possible keyword
+    const char *(*findSkipStop)(const char *at, const char *end, char first, char last, int lastOffset);
+};
 
-    [TokenType_Identifier] = "TokenType_Identifier",
-    [TokenType_String] = "TokenType_String",
-    [TokenType_Char] = "TokenType_Char",
-    [TokenType_Number] = "TokenType_Number",
+static Scanner scanner;
 
-    [TokenType_End] = "TokenType_End"
-};
+static inline bool
+isIdentifierChar(char c) {
+    return isAlphabetic(c) || isDigit(c) || c == '_';
+}
 
-struct Token {
-    TokenType type;
-    int line;
-    int column;
-    String text;
-};
+static const char *
+scalarSkipWhitespace(const char *at, const char *end) {
+    while (at < end && (isWhitespace(*at) || isNewline(*at))) at++;
+    return at;
+}
 
-static inline const char *
-tokenTypeName(unsigned tokenType) {
-    if (tokenType > arrayLength(tokenTypeNames)) return "<<unknown>>";
-    return tokenTypeNames[tokenType];
+static const char *
+scalarSkipIdentifier(const char *at, const char *end) {
+    while (at < end && isIdentifierChar(*at)) at++;
+    return at;
 }
 
-static inline bool 
-isValid(Tokenizer* tokenizer) {
-    return tokenizer->at[0] != '\0';
+static const char *
+scalarFindEither(const char *at, const char *end, char a, char b) {
+    while (at < end && *at != a && *at != b) at++;
+    return at;
 }
 
-static void 
-advance(Tokenizer* tokenizer, int distance = 1) {
-    while (isValid(tokenizer) && distance > 0) {
-        if (isNewline(tokenizer->at[0])) {
-            tokenizer->column = 1;
-            tokenizer->line++;
-        } else {
-            tokenizer->column++;
-        }
+static inline bool
+isSkipStop(char c) {
+    return c == '/' || c == '"' || c == '\'' || c == '#';
+}
 
-        tokenizer->at++;
-        distance--;
+static const char *
+scalarFindSkipStop(const char *at, const char *end, char first, char last, int lastOffset) {
+    for (; at < end; at++) {
+        if (isSkipStop(*at)) break;
+        if (*at == first && end - at > lastOffset && at[lastOffset] == last) break;
     }
+    return at;
 }
 
-static void 
+#if defined(__x86_64__) || defined(__i386__)
+#define METATOOL_X86 1
+#include <immintrin.h>
+
+/*
+ * SSE2, 16 bytes at a time. Signed byte compares are fine for all of these classes because every byte >= 0x80 is
+ * negative and so falls outside of every range we test for.
+ */
+
+__attribute__((target("sse2"))) static inline unsigned
+sse2WhitespaceMask(__m128i v) {
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    // '\t', '\n', '\v', '\f' and '\r' are the contiguous range 9-13
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(8)), _mm_cmpgt_epi8(_mm_set1_epi8(14), v));
+    return _mm_movemask_epi8(_mm_or_si128(space, control));
+}
+
+__attribute__((target("sse2"))) static inline unsigned
+sse2IdentifierMask(__m128i v) {
+    // Setting 0x20 folds upper case onto lower case without pulling any other character into a-z
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), underscore));
+}
+
+__attribute__((target("sse2"))) static inline unsigned
+sse2EitherMask(__m128i v, char a, char b) {
+    return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b))));
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2SkipWhitespace(const char *at, const char *end) {
+    for (; end - at >= 16; at += 16) {
+        unsigned mask = sse2WhitespaceMask(_mm_loadu_si128((const __m128i *)at));
+        if (mask != 0xFFFF) return at + __builtin_ctz(~mask);
+    }
+    return scalarSkipWhitespace(at, end);
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2SkipIdentifier(const char *at, const char *end) {
+    for (; end - at >= 16; at += 16) {
+        unsigned mask = sse2IdentifierMask(_mm_loadu_si128((const __m128i *)at));
+        if (mask != 0xFFFF) return at + __builtin_ctz(~mask);
+    }
+    return scalarSkipIdentifier(at, end);
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2FindEither(const char *at, const char *end, char a, char b) {
+    for (; end - at >= 16; at += 16) {
+        unsigned mask = sse2EitherMask(_mm_loadu_si128((const __m128i *)at), a, b);
+        if (mask) return at + __builtin_ctz(mask);
+    }
+    return scalarFindEither(at, end, a, b);
+}
+
+/*
+ * Matching the first and last bytes of the keyword at once rules out nearly every other identifier that happens to
+ * share its first letter.
+ */
+__attribute__((target("sse2"))) static const char *
+sse2FindSkipStop(const char *at, const char *end, char first, char last, int lastOffset) {
+    for (; end - at >= 16 + lastOffset; at += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)at);
+        __m128i lastBytes = _mm_loadu_si128((const __m128i *)(at + lastOffset));
+        __m128i stops = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')), _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(v, _mm_set1_epi8('#'))));
+        __m128i keyword = _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(first)), _mm_cmpeq_epi8(lastBytes, _mm_set1_epi8(last)));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(stops, keyword));
+        if (mask) return at + __builtin_ctz(mask);
+    }
+    return scalarFindSkipStop(at, end, first, last, lastOffset);
+}
+
+/*
+ * AVX2, 32 bytes at a time. Same classification as above, just wider.
+ */
+
+__attribute__((target("avx2"))) static inline unsigned
+avx2WhitespaceMask(__m256i v) {
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(8)), _mm256_cmpgt_epi8(_mm256_set1_epi8(14), v));
+    return _mm256_movemask_epi8(_mm256_or_si256(space, control));
+}
+
+__attribute__((target("avx2"))) static inline unsigned
+avx2IdentifierMask(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), underscore));
+}
+
+__attribute__((target("avx2"))) static inline unsigned
+avx2EitherMask(__m256i v, char a, char b) {
+    return _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b))));
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2SkipWhitespace(const char *at, const char *end) {
+    for (; end - at >= 32; at += 32) {
+        unsigned mask = avx2WhitespaceMask(_mm256_loadu_si256((const __m256i *)at));
+        if (mask != 0xFFFFFFFF) return at + __builtin_ctz(~mask);
+    }
+    return sse2SkipWhitespace(at, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2SkipIdentifier(const char *at, const char *end) {
+    for (; end - at >= 32; at += 32) {
+        unsigned mask = avx2IdentifierMask(_mm256_loadu_si256((const __m256i *)at));
+        if (mask != 0xFFFFFFFF) return at + __builtin_ctz(~mask);
+    }
+    return sse2SkipIdentifier(at, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2FindEither(const char *at, const char *end, char a, char b) {
+    for (; end - at >= 32; at += 32) {
+        unsigned mask = avx2EitherMask(_mm256_loadu_si256((const __m256i *)at), a, b);
+        if (mask) return at + __builtin_ctz(mask);
+    }
+    return sse2FindEither(at, end, a, b);
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2FindSkipStop(const char *at, const char *end, char first, char last, int lastOffset) {
+    for (; end - at >= 32 + lastOffset; at += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)at);
+        __m256i lastBytes = _mm256_loadu_si256((const __m256i *)(at + lastOffset));
+        __m256i stops = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#'))));
+        __m256i keyword = _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(first)), _mm256_cmpeq_epi8(lastBytes, _mm256_set1_epi8(last)));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(stops, keyword));
+        if (mask) return at + __builtin_ctz(mask);
+    }
+    return sse2FindSkipStop(at, end, first, last, lastOffset);
+}
+#endif
+
+static bool
+scannerIsSupported(ScannerKind kind) {
+    switch (kind) {
+    case ScannerKind_Auto:
+    case ScannerKind_Scalar:
+        return true;
+#ifdef METATOOL_X86
+    case ScannerKind_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case ScannerKind_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+/*
+ * Selects the scanner implementation. Auto picks SSE2 when the CPU supports it: most runs the tokenizer skips are
+ * shorter than 16 bytes, so AVX2 gains nothing on the first block and measures slower than SSE2 overall (see
+ * --benchmark-tokenizer). It is still available with --scanner avx2.
+ */
+static void
+initScanner(ScannerKind kind) {
+    if (kind == ScannerKind_Auto) {
+        kind = ScannerKind_Scalar;
+        if (scannerIsSupported(ScannerKind_SSE2)) kind = ScannerKind_SSE2;
+    }
+
+    if (!scannerIsSupported(kind)) {
+        fatal("The %s scanner is not supported on this CPU\n", scannerKindNames[kind]);
+    }
+
+    scanner = {};
+    scanner.kind = kind;
+
+    switch (kind) {
+#ifdef METATOOL_X86
+    case ScannerKind_SSE2:
+        scanner.skipWhitespace = sse2SkipWhitespace;
+        scanner.skipIdentifier = sse2SkipIdentifier;
+        scanner.findEither = sse2FindEither;
+        scanner.findSkipStop = sse2FindSkipStop;
+        break;
+
+    case ScannerKind_AVX2:
+        scanner.skipWhitespace = avx2SkipWhitespace;
+        scanner.skipIdentifier = avx2SkipIdentifier;
+        scanner.findEither = avx2FindEither;
+        scanner.findSkipStop = avx2FindSkipStop;
+        break;
+#endif
+
+    default:
+        scanner.skipWhitespace = scalarSkipWhitespace;
+        scanner.skipIdentifier = scalarSkipIdentifier;
+        scanner.findEither = scalarFindEither;
+        scanner.findSkipStop = scalarFindSkipStop;
+        break;
+    }
+}
+
+/*
+ * Tokenizer
+ */
+
+/*
+ * Offsets of the first character of every line, built the first time a diagnostic needs a line and column.
+ */
+struct LineIndex {
+    int *lineStarts;
+    int lineCount;
+};
+
+struct Tokenizer {
+    const char* start;
+    const char* at;
+    const char* end;
+    LineIndex lines;
+    // Indexed by TokenType, only set for --stats
+    uint64_t *tokenCounts;
+};
+
+struct TextPosition {
+    int line;
+    int column;
+};
+
+enum TokenType {
+    TokenType_Unknown,
+
+    TokenType_LeftBrace,
+    TokenType_RightBrace,
+    TokenType_LeftParen,
+    TokenType_RightParen,
+    TokenType_LeftBracket,
+    TokenType_RightBracket,
+    TokenType_Slash,
+    TokenType_Asterisk,
+    TokenType_Semicolon,
+    TokenType_Colon,
+    TokenType_Pound,
+    TokenType_Equals,
+    TokenType_Period,
+    TokenType_Comma,
+    TokenType_LeftCaret,
+    TokenType_RightCaret,
+    TokenType_Plus,
+    TokenType_Minus,
+    TokenType_Not,
+    TokenType_And,
+    TokenType_Or,
+    TokenType_Tilde,
+    TokenType_Question,
+    TokenType_Caret,
+    TokenType_Percent,
+
+    TokenType_Identifier,
+    TokenType_String,
+    TokenType_Char,
+    TokenType_Number,
+
+    TokenType_End
+};
+
+const char *tokenTypeNames[] = {
+    [TokenType_Unknown] = "TokenType_Unknown",
+
+    [TokenType_LeftBrace] = "TokenType_LeftBrace",
+    [TokenType_RightBrace] = "TokenType_RightBrace",
+    [TokenType_LeftParen] = "TokenType_LeftParen",
+    [TokenType_RightParen] = "TokenType_RightParen",
+    [TokenType_LeftBracket] = "TokenType_LeftBracket",
+    [TokenType_RightBracket] = "TokenType_RightBracket",
+    [TokenType_Slash] = "TokenType_Slash",
+    [TokenType_Asterisk] = "TokenType_Asterisk",
+    [TokenType_Semicolon] = "TokenType_Semicolon",
+    [TokenType_Colon] = "TokenType_Colon",
+    [TokenType_Pound] = "TokenType_Pound",
+    [TokenType_Equals] = "TokenType_Equals",
+    [TokenType_Period] = "TokenType_Period",
+    [TokenType_Comma] = "TokenType_Comma",
+    [TokenType_LeftCaret] = "TokenType_LeftCaret",
+    [TokenType_RightCaret] = "TokenType_RightCaret",
+    [TokenType_Plus] = "TokenType_Plus",
+    [TokenType_Minus] = "TokenType_Minus",
+    [TokenType_Not] = "TokenType_Not",
+    [TokenType_And] = "TokenType_And",
+    [TokenType_Or] = "TokenType_Or",
+    [TokenType_Tilde] = "TokenType_Tilde",
+    [TokenType_Question] = "TokenType_Question",
+    [TokenType_Caret] = "TokenType_Caret",
+    [TokenType_Percent] = "TokenType_Percent",
+
+    [TokenType_Identifier] = "TokenType_Identifier",
+    [TokenType_String] = "TokenType_String",
+    [TokenType_Char] = "TokenType_Char",
+    [TokenType_Number] = "TokenType_Number",
+
+    [TokenType_End] = "TokenType_End"
+};
+
+struct Token {
+    TokenType type;
+    int offset;
+    String text;
+};
+
+/*
+ * Counters for --stats. Inputs are parsed on several threads at once, so the read, tokenize and parse times are
+ * summed over every worker and can add up to more than the wall time.
+ */
+struct PhaseStats {
+    uint64_t readNanoseconds;
+    uint64_t tokenizeNanoseconds;
+    uint64_t parseNanoseconds;
+    uint64_t tokenCounts[TokenType_End + 1];
+    int parsedFileCount;
+    int cachedFileCount;
+    int outputFileCount;
+    uint64_t outputBytes;
+    uint64_t writtenBytes;
+};
+
+static PhaseStats phaseStats = {};
+
+static void
+addElapsedNanoseconds(uint64_t *counter, double start) {
+    __atomic_fetch_add(counter, (uint64_t)((getSeconds() - start) * 1e9), __ATOMIC_RELAXED);
+}
+
+static inline const char *
+tokenTypeName(unsigned tokenType) {
+    if (tokenType > arrayLength(tokenTypeNames)) return "<<unknown>>";
+    return tokenTypeNames[tokenType];
+}
+
+static inline bool 
+isValid(Tokenizer* tokenizer) {
+    return tokenizer->at < tokenizer->end;
+}
+
+/*
+ * Bounds checked lookahead, reads past the end of the input come back as '\0'.
+ */
+static inline char
+peek(Tokenizer* tokenizer, int offset = 0) {
+    return (tokenizer->at + offset < tokenizer->end) ? tokenizer->at[offset] : '\0';
+}
+
+static void
+initTokenizer(Tokenizer* tokenizer, FileData *file) {
+    *tokenizer = {};
+    tokenizer->start = file->data;
+    tokenizer->at = file->data;
+    tokenizer->end = file->data + file->size;
+}
+
+static void
+freeTokenizer(Tokenizer* tokenizer) {
+    free(tokenizer->lines.lineStarts);
+    tokenizer->lines = {};
+}
+
+static void 
+advance(Tokenizer* tokenizer, int distance = 1) {
+    if (distance > tokenizer->end - tokenizer->at) {
+        distance = tokenizer->end - tokenizer->at;
+    }
+    tokenizer->at += distance;
+}
+
+static void
+advanceTo(Tokenizer* tokenizer, const char *target) {
+    tokenizer->at = target;
+}
+
+/*
+ * Line and column of a byte offset, 1 based. Every '\r' and every '\n' starts a new line, which is how these have
+ * always been counted.
+ */
+static TextPosition
+getPosition(Tokenizer* tokenizer, int offset) {
+    LineIndex *lines = &tokenizer->lines;
+
+    if (!lines->lineStarts) {
+        int capacity = 1024;
+        lines->lineStarts = (int *)malloc(capacity * sizeof(int));
+        lines->lineStarts[lines->lineCount++] = 0;
+
+        const char *at = tokenizer->start;
+        for (;;) {
+            at = scanner.findEither(at, tokenizer->end, '\n', '\r');
+            if (at == tokenizer->end) break;
+            at++;
+
+            if (lines->lineCount == capacity) {
+                capacity *= 2;
+                lines->lineStarts = (int *)realloc(lines->lineStarts, capacity * sizeof(int));
+            }
+            lines->lineStarts[lines->lineCount++] = at - tokenizer->start;
+        }
+    }
+
+    // Find the last line that starts at or before the offset
+    int low = 0;
+    int high = lines->lineCount - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (lines->lineStarts[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    TextPosition result;
+    result.line = low + 1;
+    result.column = offset - lines->lineStarts[low] + 1;
+    return result;
+}
+
+static inline TextPosition
+getPosition(Tokenizer* tokenizer, Token *token) {
+    return getPosition(tokenizer, token->offset);
+}
+
+static void 
 eatWhitespace(Tokenizer* tokenizer) {
-    while (isValid(tokenizer) && (isWhitespace(tokenizer->at[0]) | isNewline(tokenizer->at[0]))) {
+    // Tokens are very often directly adjacent or separated by a single space
+    if (isValid(tokenizer) && (isWhitespace(peek(tokenizer)) | isNewline(peek(tokenizer)))) {
         advance(tokenizer);
+        if (isValid(tokenizer) && (isWhitespace(peek(tokenizer)) | isNewline(peek(tokenizer)))) {
+            advanceTo(tokenizer, scanner.skipWhitespace(tokenizer->at, tokenizer->end));
+        }
     }
 }
 
 static void 
 eatLine(Tokenizer* tokenizer) {
-    int line = tokenizer->line;
-    while (isValid(tokenizer) && tokenizer->line == line) {
-        advance(tokenizer);
+    const char *lineEnd = scanner.findEither(tokenizer->at, tokenizer->end, '\n', '\r');
+    if (lineEnd < tokenizer->end) {
+        // Eat the newline itself too
+        lineEnd++;
+    }
+    advanceTo(tokenizer, lineEnd);
+}
+
+/*
+ * Skips the body of a string or character literal, leaving the tokenizer on the closing quote or at the end of the
+ * input if it was unterminated.
+ */
+static void
+eatLiteral(Tokenizer* tokenizer, char quote) {
+    for (;;) {
+        const char *at = scanner.findEither(tokenizer->at, tokenizer->end, quote, '\\');
+        advanceTo(tokenizer, at);
+
+        if (peek(tokenizer) != '\\') break;
+
+        // Handle escape sequence by chomping the next character
+        advance(tokenizer, 2);
+    }
+}
+
+/*
+ * Skips to just past the closing star and slash, the opening ones having already been eaten.
+ */
+static void
+eatBlockComment(Tokenizer* tokenizer) {
+    while (isValid(tokenizer)) {
+        advanceTo(tokenizer, scanner.findEither(tokenizer->at, tokenizer->end, '*', '*'));
+        if (peek(tokenizer) == '*' && peek(tokenizer, 1) == '/') {
+            advance(tokenizer, 2);
+            break;
+        } else {
+            advance(tokenizer);
+        }
+    }
+}
+
+/*
+ * Skips a whole string or character literal starting at the opening quote.
+ */
+static void
+eatQuoted(Tokenizer* tokenizer) {
+    char quote = peek(tokenizer);
+    int offset = tokenizer->at - tokenizer->start;
+
+    advance(tokenizer);
+    eatLiteral(tokenizer, quote);
+
+    if (!isValid(tokenizer)) {
+        TextPosition position = getPosition(tokenizer, offset);
+        fatal("Unterminated %s literal, started at %d:%d\n", quote == '"' ? "string" : "character", position.line, position.column);
     }
+
+    advance(tokenizer);
 }
 
 static Token 
 getToken(Tokenizer* tokenizer) {
     Token token = {};
 
-#define current tokenizer->at[0]
-#define after tokenizer->at[1]
+#define current peek(tokenizer)
+#define after peek(tokenizer, 1)
 #define CASE1(c, t) case c: token.type = t; advance(tokenizer); break;
 
 resume:
     eatWhitespace(tokenizer);
 
     token.type = TokenType_Unknown;
-    token.line = tokenizer->line;
-    token.column = tokenizer->column;
+    token.offset = tokenizer->at - tokenizer->start;
     token.text.data = tokenizer->at;
 
-    switch (tokenizer->at[0]) {
+    switch (current) {
     case '\0':
-        token.type = TokenType_End;
+        if (isValid(tokenizer)) {
+            // Stray null byte in the middle of the input
+            advance(tokenizer);
+        } else {
+            token.type = TokenType_End;
+        }
         break;
 
     CASE1('{', TokenType_LeftBrace);
@@ -321,6 +1244,8 @@ resume:
     CASE1('|', TokenType_Or);
     CASE1('~', TokenType_Tilde);
     CASE1('?', TokenType_Question);
+    CASE1('^', TokenType_Caret);
+    CASE1('%', TokenType_Percent);
 
     case '#':
         // Skip all compiler directives for now by ignoring the rest of the line
@@ -337,14 +1262,7 @@ resume:
         } else if (current == '*') {
             // C comment
             advance(tokenizer);
-            while (isValid(tokenizer)) {
-                if (current == '*' && after == '/') {
-                    advance(tokenizer, 2);
-                    break;
-                } else {
-                    advance(tokenizer);
-                }
-            }
+            eatBlockComment(tokenizer);
             goto resume;
         } else {
             token.type = TokenType_Slash;
@@ -353,51 +1271,22 @@ resume:
 
     case '\'':
         token.type = TokenType_Char;
-        advance(tokenizer);
-
-        while (isValid(tokenizer) && current != '\'') {
-            if (current == '\\') {
-                // Handle escape sequence by chomping the next character
-                advance(tokenizer);
-            }
-            advance(tokenizer);
-        }
-
-        if (!isValid(tokenizer)) {
-            fatal("Unterminated character literal, started at %d:%d\n", token.line, token.column);
-        }
-
-        advance(tokenizer);
+        eatQuoted(tokenizer);
         break;
 
     case '"':
         token.type = TokenType_String;
-        advance(tokenizer);
-
-        while (isValid(tokenizer) && current != '"') {
-            if (current == '\\') {
-                // Handle escape sequence by chomping the next character
-                advance(tokenizer);
-            }
-            advance(tokenizer);
-        }
-
-        if (!isValid(tokenizer)) {
-            fatal("Unterminated string literal, started at %d:%d\n", token.line, token.column);
-        }
-
-        advance(tokenizer);
+        eatQuoted(tokenizer);
         break;
 
     default:
         if (isAlphabetic(current) || current == '_') {
             token.type = TokenType_Identifier;
-            while (isAlphabetic(current) || isDigit(current) || current == '_') {
-                advance(tokenizer);
-            }
+            advanceTo(tokenizer, scanner.skipIdentifier(tokenizer->at, tokenizer->end));
         } else if (isDigit(current)) {
             token.type = TokenType_Number;
-            while (isDigit(current) || current == '.') {
+            // Take hex digits, suffixes and the like along with the digits
+            while (isIdentifierChar(current) || current == '.') {
                 advance(tokenizer);
             }
         } else {
@@ -408,8 +1297,13 @@ resume:
 
     token.text.length = tokenizer->at - token.text.data;
 
+    if (tokenizer->tokenCounts) {
+        tokenizer->tokenCounts[token.type]++;
+    }
+
     if (printAllTokens) {
-        printf("[%d:%d] %s: %.*s\n", token.line, token.column, tokenTypeName(token.type), token.text.length, token.text.data);
+        TextPosition position = getPosition(tokenizer, &token);
+        printf("[%d:%d] %s: %.*s\n", position.line, position.column, tokenTypeName(token.type), token.text.length, token.text.data);
     }
 
 #undef CASE1
@@ -420,20 +1314,138 @@ resume:
 }
 
 static void 
-ensureToken(Token *token, TokenType type) {
+ensureToken(Tokenizer *tokenizer, Token *token, TokenType type) {
   if (token->type != type) {
+      TextPosition position = getPosition(tokenizer, token);
       fatal("[%d, %d] Expected token %s, got \"%.*s\" which is type %s\n", 
-              token->line, token->column, tokenTypeName(type), token->text.length, token->text.data, tokenTypeName(token->type));
+              position.line, position.column, tokenTypeName(type), token->text.length, token->text.data, tokenTypeName(token->type));
   }
 }
 
 static Token 
 requireToken(Tokenizer *tokenizer, TokenType type) {
     Token token = getToken(tokenizer);
-    ensureToken(&token, type);
+    ensureToken(tokenizer, &token, type);
     return token;
 }
 
+static int
+tokenizeAll(Tokenizer *tokenizer) {
+    int tokenCount = 0;
+    while (getToken(tokenizer).type != TokenType_End) {
+        tokenCount++;
+    }
+    return tokenCount;
+}
+
+static int
+tokenizeOnly(FileData *file) {
+    Tokenizer tokenizer;
+    initTokenizer(&tokenizer, file);
+    int tokenCount = tokenizeAll(&tokenizer);
+    freeTokenizer(&tokenizer);
+    return tokenCount;
+}
+
+/*
+ * Called at each point where the parser is between definitions and nothing before it matters any more, which is every
+ * stop of the skip scan when skipping and the start of every top level token otherwise. Two parses that pass the same
+ * rest point carry on identically from there, so these are where a chunk is checked against the one before it, see
+ * parseChunks. Returns whether the chunk ends here.
+ */
+static inline bool
+passRestPoint(int offset) {
+    ChunkSync *sync = chunkSync;
+    if (!sync) return false;
+
+    sync->lastRestPoint = offset;
+
+    if (offset < sync->windowEnd) {
+        if (sync->restPointCount == sync->restPointCapacity) {
+            sync->restPointCapacity = sync->restPointCapacity ? sync->restPointCapacity * 2 : 256;
+            sync->restPoints = (int *)realloc(sync->restPoints, sync->restPointCapacity * sizeof(int));
+        }
+        sync->restPoints[sync->restPointCount++] = offset;
+    }
+
+    return offset >= sync->limit;
+}
+
+/*
+ * Moves the tokenizer up to the next Introspect keyword that getToken would return, the end of the input or the end
+ * of the chunk, without tokenizing anything in between. Comments, literals and directives are skipped exactly the way
+ * getToken skips them, so a keyword inside one is never found. Nothing in between is diagnosed either, so unknown
+ * tokens outside Introspect blocks are only warned about with --no-skip-scan.
+ */
+static void
+skipToIntrospect(Tokenizer* tokenizer) {
+    int keywordLength = strlen(keyword_introspect);
+    char first = keyword_introspect[0];
+    char last = keyword_introspect[keywordLength - 1];
+
+    while (isValid(tokenizer)) {
+        advanceTo(tokenizer, scanner.findSkipStop(tokenizer->at, tokenizer->end, first, last, keywordLength - 1));
+        if (!isValid(tokenizer) || passRestPoint((int)(tokenizer->at - tokenizer->start))) break;
+
+        switch (peek(tokenizer)) {
+        case '#':
+            eatLine(tokenizer);
+            break;
+
+        case '/':
+            if (peek(tokenizer, 1) == '/') {
+                eatLine(tokenizer);
+            } else if (peek(tokenizer, 1) == '*') {
+                advance(tokenizer, 2);
+                eatBlockComment(tokenizer);
+            } else {
+                advance(tokenizer);
+            }
+            break;
+
+        case '"':
+        case '\'':
+            eatQuoted(tokenizer);
+            break;
+
+        default:
+        {
+            // Only a whole identifier counts, the stop could be in the middle of a longer one
+            const char *at = tokenizer->at;
+            bool isKeyword = tokenizer->end - at >= keywordLength && memcmp(at, keyword_introspect, keywordLength) == 0 &&
+                             (at == tokenizer->start || !isIdentifierChar(at[-1])) &&
+                             (at + keywordLength == tokenizer->end || !isIdentifierChar(at[keywordLength]));
+            if (isKeyword) return;
+            advance(tokenizer);
+            break;
+        }
+        }
+    }
+}
+
+/*
+ * What parseFile reads of an input when skipping, which is just the scan plus the keywords themselves.
+ */
+static int
+skipScanAll(Tokenizer *tokenizer) {
+    int markerCount = 0;
+    for (;;) {
+        skipToIntrospect(tokenizer);
+        if (getToken(tokenizer).type == TokenType_End) break;
+        markerCount++;
+    }
+    return markerCount;
+}
+
+static int
+skipScanOnly(FileData *file) {
+    Tokenizer tokenizer;
+    initTokenizer(&tokenizer, file);
+    int markerCount = skipScanAll(&tokenizer);
+    freeTokenizer(&tokenizer);
+    return markerCount;
+}
+
 static bool
 tokenMatchesString(Token *token, const char *keyword) {
     int keywordLength = strlen(keyword);
@@ -445,6 +1457,20 @@ tokenMatchesString(Token *token, const char *keyword) {
  * Parser
  */
 
+/*
+ * Options passed to Introspect(), e.g. Introspect(soa). Stored as a bitmask on the struct or enum that follows, with
+ * each option's bit being its index in introspectOptionNames.
+ */
+enum IntrospectOption {
+    IntrospectOption_Soa = 1 << 0,
+    IntrospectOption_Flags = 1 << 1
+};
+
+static const char *introspectOptionNames[] = {
+    "soa",
+    "flags"
+};
+
 struct StructMember {
     Token type;
     Token name;
@@ -456,6 +1482,9 @@ struct StructMember {
 
 struct Struct {
     Token name;
+    uint32_t options;
+    // Just past the closing semicolon, so --watch knows which definitions an edit can't have touched
+    int endOffset;
     int memberCount;
     StructMember *firstMember;
     Struct *next;
@@ -463,19 +1492,265 @@ struct Struct {
 
 struct EnumMember {
     Token name;
+    // Whether we could work out the value, which needs it to be built from literals and earlier members
+    bool isValueKnown;
+    int64_t value;
     EnumMember *next;
 };
 
 struct Enum {
     Token name;
+    uint32_t options;
+    int endOffset;
     int memberCount;
     EnumMember *firstMember;
     Enum *next;
 };
 
+/*
+ * Enum values
+ *
+ * Enough of a constant expression evaluator to work out the values of enum members written with literals, the usual
+ * operators and references to earlier members of the same enum. Anything else, like a constant from elsewhere, leaves
+ * the value unknown and the generated code falls back to letting the compiler work it out.
+ */
+
+struct ValueExpression {
+    Token *tokens;
+    int count;
+    int at;
+    Enum *e;
+    bool failed;
+};
+
+static bool
+parseIntegerLiteral(Token *token, int64_t *value) {
+    char digits[72];
+    int length = 0;
+    for (int i = 0; i < token->text.length && length < arrayLength(digits) - 1; i++) {
+        char c = token->text.data[i];
+        if (c != '\'') digits[length++] = c;
+    }
+    // Drop any u/l suffixes
+    while (length > 1 && (digits[length - 1] == 'u' || digits[length - 1] == 'U' || 
+                digits[length - 1] == 'l' || digits[length - 1] == 'L')) {
+        length--;
+    }
+    digits[length] = '\0';
+
+    int base = 0;
+    const char *start = digits;
+    if (digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B')) {
+        base = 2;
+        start += 2;
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long result = strtoull(start, &end, base);
+    if (errno != 0 || end == start || *end != '\0') return false;
+
+    *value = (int64_t)result;
+    return true;
+}
+
+static bool
+parseCharLiteral(Token *token, int64_t *value) {
+    const char *text = token->text.data;
+    int length = token->text.length;
+
+    if (length == 3) {
+        *value = text[1];
+        return true;
+    }
+
+    if (length == 4 && text[1] == '\\') {
+        switch (text[2]) {
+        case 'n': *value = '\n'; return true;
+        case 'r': *value = '\r'; return true;
+        case 't': *value = '\t'; return true;
+        case '0': *value = '\0'; return true;
+        case '\\': *value = '\\'; return true;
+        case '\'': *value = '\''; return true;
+        case '"': *value = '"'; return true;
+        }
+    }
+
+    return false;
+}
+
+static inline Token *
+peekValueToken(ValueExpression *expression) {
+    return expression->at < expression->count ? expression->tokens + expression->at : nullptr;
+}
+
+/*
+ * << and >> arrive as two adjacent caret tokens.
+ */
+static inline bool
+isShift(ValueExpression *expression, TokenType type) {
+    Token *token = peekValueToken(expression);
+    if (!token || token->type != type || expression->at + 1 >= expression->count) return false;
+
+    Token *next = token + 1;
+    return next->type == type && next->offset == token->offset + 1;
+}
+
+static int64_t evaluateValue(ValueExpression *expression, int minimumPrecedence);
+
+static int64_t
+evaluatePrimary(ValueExpression *expression) {
+    Token *token = peekValueToken(expression);
+    if (!token) {
+        expression->failed = true;
+        return 0;
+    }
+    expression->at++;
+
+    int64_t value = 0;
+
+    switch (token->type) {
+    case TokenType_Minus:
+        return -evaluatePrimary(expression);
+    case TokenType_Plus:
+        return evaluatePrimary(expression);
+    case TokenType_Tilde:
+        return ~evaluatePrimary(expression);
+    case TokenType_Not:
+        return !evaluatePrimary(expression);
+
+    case TokenType_LeftParen: {
+        value = evaluateValue(expression, 0);
+        Token *close = peekValueToken(expression);
+        if (!close || close->type != TokenType_RightParen) {
+            expression->failed = true;
+        }
+        expression->at++;
+        return value;
+    }
+
+    case TokenType_Number:
+        if (!parseIntegerLiteral(token, &value)) expression->failed = true;
+        return value;
+
+    case TokenType_Char:
+        if (!parseCharLiteral(token, &value)) expression->failed = true;
+        return value;
+
+    case TokenType_Identifier:
+        // Members are still in reverse order while parsing, so this finds the latest definition first
+        for (EnumMember *member = expression->e->firstMember; member; member = member->next) {
+            if (member->name.text.length == token->text.length && 
+                    memcmp(member->name.text.data, token->text.data, token->text.length) == 0) {
+                if (!member->isValueKnown) expression->failed = true;
+                return member->value;
+            }
+        }
+        expression->failed = true;
+        return 0;
+
+    default:
+        expression->failed = true;
+        return 0;
+    }
+}
+
+/*
+ * Precedence climbing over the binary operators, with C's precedence.
+ */
+static int64_t
+evaluateValue(ValueExpression *expression, int minimumPrecedence) {
+    int64_t left = evaluatePrimary(expression);
+
+    while (!expression->failed) {
+        Token *token = peekValueToken(expression);
+        if (!token) break;
+
+        TokenType op = token->type;
+        int width = 1;
+        int precedence = 0;
+
+        if (isShift(expression, TokenType_LeftCaret) || isShift(expression, TokenType_RightCaret)) {
+            precedence = 8;
+            width = 2;
+        } else {
+            switch (op) {
+            case TokenType_Asterisk: case TokenType_Slash: case TokenType_Percent: precedence = 10; break;
+            case TokenType_Plus: case TokenType_Minus: precedence = 9; break;
+            case TokenType_And: precedence = 5; break;
+            case TokenType_Caret: precedence = 4; break;
+            case TokenType_Or: precedence = 3; break;
+            default: break;
+            }
+        }
+
+        if (!precedence || precedence < minimumPrecedence) break;
+        expression->at += width;
+
+        int64_t right = evaluateValue(expression, precedence + 1);
+        if (expression->failed) break;
+
+        switch (op) {
+        case TokenType_Asterisk: left = left * right; break;
+        case TokenType_Plus: left = left + right; break;
+        case TokenType_Minus: left = left - right; break;
+        case TokenType_And: left = left & right; break;
+        case TokenType_Caret: left = left ^ right; break;
+        case TokenType_Or: left = left | right; break;
+        case TokenType_LeftCaret: left = (int64_t)((uint64_t)left << (right & 63)); break;
+        case TokenType_RightCaret: left = left >> (right & 63); break;
+        case TokenType_Slash:
+        case TokenType_Percent:
+            if (right == 0) {
+                expression->failed = true;
+            } else {
+                left = op == TokenType_Slash ? left / right : left % right;
+            }
+            break;
+        default: break;
+        }
+    }
+
+    return left;
+}
+
+static uint32_t
+parseIntrospectOptions(Tokenizer *tokenizer) {
+    uint32_t options = 0;
+
+    requireToken(tokenizer, TokenType_LeftParen);
+
+    for (;;) {
+        Token token = getToken(tokenizer);
+        if (token.type == TokenType_RightParen) break;
+        if (token.type == TokenType_Comma) continue;
+
+        TextPosition position = getPosition(tokenizer, &token);
+        if (token.type != TokenType_Identifier) {
+            fatal("[%d:%d] Expected an Introspect option, got \"%.*s\"\n", position.line, position.column, 
+                  token.text.length, token.text.data);
+        }
+
+        bool found = false;
+        for (int i = 0; i < arrayLength(introspectOptionNames); i++) {
+            if (tokenMatchesString(&token, introspectOptionNames[i])) {
+                options |= 1u << i;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            warn("[%d:%d] Unknown Introspect option \"%.*s\"\n", position.line, position.column, 
+                 token.text.length, token.text.data);
+        }
+    }
+
+    return options;
+}
+
 static StructMember*
-parseStructMember(Tokenizer *tokenizer, Token *memberType) {
-    StructMember *member = allocStruct(StructMember);
+parseStructMember(Tokenizer *tokenizer, Arena *arena, Token *memberType) {
+    StructMember *member = pushStruct(arena, StructMember);
     member->type = *memberType;
 
     Token token = getToken(tokenizer);
@@ -486,337 +1761,5207 @@ parseStructMember(Tokenizer *tokenizer, Token *memberType) {
         member->name = token;
     }
 
-    token = getToken(tokenizer);
-    if (token.type == TokenType_LeftBracket) {
-        member->isArray = true;
-        member->arraySize = getToken(tokenizer);
-        requireToken(tokenizer, TokenType_RightBracket);
-        requireToken(tokenizer, TokenType_Semicolon);
-    } else {
-        ensureToken(&token, TokenType_Semicolon);
+    token = getToken(tokenizer);
+    if (token.type == TokenType_LeftBracket) {
+        member->isArray = true;
+        member->arraySize = getToken(tokenizer);
+        requireToken(tokenizer, TokenType_RightBracket);
+        requireToken(tokenizer, TokenType_Semicolon);
+    } else {
+        ensureToken(tokenizer, &token, TokenType_Semicolon);
+    }
+    
+    return member;
+}
+
+static Struct *
+parseStruct(Tokenizer *tokenizer, Arena *arena) {
+    Struct *new_struct = pushStruct(arena, Struct);
+
+    new_struct->name = requireToken(tokenizer, TokenType_Identifier);
+
+    requireToken(tokenizer, TokenType_LeftBrace);
+
+    for (;;) {
+        Token token = getToken(tokenizer);
+
+        if (token.type == TokenType_RightBrace) {
+            break;
+        }
+
+        StructMember *member = parseStructMember(tokenizer, arena, &token);
+        if (!new_struct->firstMember) {
+            new_struct->firstMember = member;
+        } else {
+            member->next = new_struct->firstMember;
+            new_struct->firstMember = member;
+        }
+
+        new_struct->memberCount++;
+    }
+    requireToken(tokenizer, TokenType_Semicolon);
+
+    reverse(&new_struct->firstMember);
+
+    return new_struct;
+}
+
+static Enum *
+parseEnum(Tokenizer *tokenizer, Arena *arena) {
+    Enum *new_enum = pushStruct(arena, Enum);
+
+    new_enum->name = requireToken(tokenizer, TokenType_Identifier);
+
+    requireToken(tokenizer, TokenType_LeftBrace);
+    Token token = getToken(tokenizer);
+
+    for (;;) {
+        if (token.type == TokenType_RightBrace) {
+            break;
+        }
+
+        EnumMember *member = pushStruct(arena, EnumMember);
+        member->name = token;
+
+        token = getToken(tokenizer);
+        if (token.type == TokenType_Equals) {
+            // Gather up the value expression, which ends at a comma or brace outside of any parentheses
+            Token valueTokens[128];
+            int valueTokenCount = 0;
+            int depth = 0;
+
+            token = getToken(tokenizer);
+            while (token.type != TokenType_End && (depth > 0 || (token.type != TokenType_Comma && token.type != TokenType_RightBrace))) {
+                if (token.type == TokenType_LeftParen) depth++;
+                if (token.type == TokenType_RightParen) depth--;
+                if (valueTokenCount < arrayLength(valueTokens)) valueTokens[valueTokenCount] = token;
+                valueTokenCount++;
+                token = getToken(tokenizer);
+            }
+
+            if (valueTokenCount == 0) {
+                TextPosition position = getPosition(tokenizer, &token);
+                fatal("[%d:%d] Unknown enum value \"%.*s\"\n", position.line, position.column, token.text.length, token.text.data);
+            }
+
+            if (valueTokenCount <= arrayLength(valueTokens)) {
+                ValueExpression expression = {};
+                expression.tokens = valueTokens;
+                expression.count = valueTokenCount;
+                expression.e = new_enum;
+
+                member->value = evaluateValue(&expression, 0);
+                member->isValueKnown = !expression.failed && expression.at == expression.count;
+            }
+        } else {
+            EnumMember *previous = new_enum->firstMember;
+            member->isValueKnown = !previous || previous->isValueKnown;
+            member->value = previous ? previous->value + 1 : 0;
+        }
+
+        if (!new_enum->firstMember) {
+            new_enum->firstMember = member;
+        } else {
+            member->next = new_enum->firstMember;
+            new_enum->firstMember = member;
+        }
+
+        new_enum->memberCount++;
+
+        if (token.type == TokenType_Comma) {
+            token = getToken(tokenizer);
+        }
+    }
+    requireToken(tokenizer, TokenType_Semicolon);
+
+    reverse(&new_enum->firstMember);
+
+    return new_enum;
+}
+
+static void 
+appendFlag(char *flags, const char *flag, int *index) {
+    if (*index != 0) {
+        memcpy(flags + *index, " | ", 3);
+        *index += 3;
+    }
+    int flagLength = strlen(flag);
+    memcpy(flags + *index, flag, flagLength);
+    *index += flagLength;
+}
+
+static void
+formatMemberFlags(StructMember *member, char *flags) {
+    // TODO: This is stupid
+    int index = 0;
+    bool hasFlags = false;
+    if (member->isPointer) {
+        hasFlags = true;
+        appendFlag(flags, "Meta_StructMember_Flags_Pointer", &index);
+    }
+    if (member->isArray) {
+        hasFlags = true;
+        appendFlag(flags, "Meta_StructMember_Flags_Array", &index);
+    }
+    if (!hasFlags) {
+        appendFlag(flags, "Meta_StructMember_Flags_None", &index);
+    }
+    flags[index] = '\0';
+}
+
+/*
+ * Perfect hashing
+ *
+ * Builds collision free lookup tables for fixed sets of names at generation time, so the generated code can find a
+ * name with one hash, two table reads and a single string compare. Keys are first split into buckets by the low bits
+ * of their hash. Then, biggest bucket first, each bucket gets the smallest displacement that moves all of its keys to
+ * free slots. The generated code mirrors metaNameHash and perfectHashSlot exactly.
+ */
+
+struct PerfectHash {
+    // Both powers of two
+    int bucketCount;
+    int slotCount;
+    uint32_t *displacements;
+    // Key index for each slot, -1 if empty
+    int *slots;
+};
+
+static uint64_t
+metaNameHash(const char *name, int length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static inline uint32_t
+perfectHashSlot(uint64_t hash, uint32_t displacement, uint32_t mask) {
+    uint64_t mixed = (hash ^ (displacement * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+    return (uint32_t)(mixed >> 32) & mask;
+}
+
+static int
+nextPowerOfTwo(int value) {
+    int result = 1;
+    while (result < value) result *= 2;
+    return result;
+}
+
+static void
+freePerfectHash(PerfectHash *hash) {
+    free(hash->displacements);
+    free(hash->slots);
+    *hash = {};
+}
+
+/*
+ * The keys must be unique.
+ */
+static void
+buildPerfectHash(PerfectHash *result, String *keys, int count) {
+    *result = {};
+
+    uint64_t *hashes = (uint64_t *)malloc((count ? count : 1) * sizeof(uint64_t));
+    for (int i = 0; i < count; i++) {
+        hashes[i] = metaNameHash(keys[i].data, keys[i].length);
+    }
+
+    int bucketCount = nextPowerOfTwo(count / 2 > 1 ? count / 2 : 1);
+    int slotCount = nextPowerOfTwo(count * 2 > 2 ? count * 2 : 2);
+
+    // Keys sorted by bucket, with the biggest buckets first
+    int *bucketSizes = (int *)calloc(bucketCount, sizeof(int));
+    int *bucketOrder = (int *)malloc(bucketCount * sizeof(int));
+    int *bucketStarts = (int *)malloc((bucketCount + 1) * sizeof(int));
+    int *bucketKeys = (int *)malloc((count ? count : 1) * sizeof(int));
+    int *bucketFill = (int *)calloc(bucketCount, sizeof(int));
+    uint32_t *bucketSlots = (uint32_t *)malloc((count ? count : 1) * sizeof(uint32_t));
+
+    for (int i = 0; i < count; i++) {
+        bucketSizes[hashes[i] & (bucketCount - 1)]++;
+    }
+
+    int largestBucket = 0;
+    bucketStarts[0] = 0;
+    for (int i = 0; i < bucketCount; i++) {
+        bucketStarts[i + 1] = bucketStarts[i] + bucketSizes[i];
+        if (bucketSizes[i] > largestBucket) largestBucket = bucketSizes[i];
+    }
+
+    for (int i = 0; i < count; i++) {
+        int bucket = hashes[i] & (bucketCount - 1);
+        bucketKeys[bucketStarts[bucket] + bucketFill[bucket]++] = i;
+    }
+
+    // Counting sort by size, which keeps equal sized buckets in a stable order. The registry can have tens of
+    // thousands of buckets, too many for an insertion sort.
+    int *sizeStarts = (int *)calloc(largestBucket + 2, sizeof(int));
+    for (int i = 0; i < bucketCount; i++) {
+        sizeStarts[largestBucket - bucketSizes[i] + 1]++;
+    }
+    for (int size = 1; size <= largestBucket + 1; size++) {
+        sizeStarts[size] += sizeStarts[size - 1];
+    }
+    for (int i = 0; i < bucketCount; i++) {
+        bucketOrder[sizeStarts[largestBucket - bucketSizes[i]]++] = i;
+    }
+    free(sizeStarts);
+
+    for (;;) {
+        result->bucketCount = bucketCount;
+        result->slotCount = slotCount;
+        result->displacements = (uint32_t *)calloc(bucketCount, sizeof(uint32_t));
+        result->slots = (int *)malloc(slotCount * sizeof(int));
+        for (int i = 0; i < slotCount; i++) result->slots[i] = -1;
+
+        uint32_t mask = slotCount - 1;
+        bool failed = false;
+
+        for (int i = 0; i < bucketCount && !failed; i++) {
+            int bucket = bucketOrder[i];
+            int size = bucketSizes[bucket];
+            if (!size) break;
+
+            int *keysInBucket = bucketKeys + bucketStarts[bucket];
+
+            uint32_t displacement = 0;
+            for (;; displacement++) {
+                if (displacement > (1u << 16)) {
+                    failed = true;
+                    break;
+                }
+
+                bool fits = true;
+                for (int k = 0; k < size && fits; k++) {
+                    uint32_t slot = perfectHashSlot(hashes[keysInBucket[k]], displacement, mask);
+                    if (result->slots[slot] >= 0) fits = false;
+                    for (int other = 0; other < k && fits; other++) {
+                        if (bucketSlots[other] == slot) fits = false;
+                    }
+                    bucketSlots[k] = slot;
+                }
+
+                if (fits) break;
+            }
+
+            if (failed) break;
+
+            result->displacements[bucket] = displacement;
+            for (int k = 0; k < size; k++) {
+                result->slots[bucketSlots[k]] = keysInBucket[k];
+            }
+        }
+
+        if (!failed) break;
+
+        // Too crowded, try again with more room
+        freePerfectHash(result);
+        slotCount *= 2;
+    }
+
+    free(hashes);
+    free(bucketSizes);
+    free(bucketOrder);
+    free(bucketStarts);
+    free(bucketKeys);
+    free(bucketFill);
+    free(bucketSlots);
+}
+
+/*
+ * Output buffer
+ *
+ * All generated code is accumulated in memory and written out in one go at the end, which also lets us skip the
+ * write entirely when the output file already has exactly this content.
+ */
+
+struct OutputBuffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static OutputBuffer output = {};
+
+static inline void
+bufferReserve(OutputBuffer *buffer, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 64 * 1024;
+        while (buffer->size + size > capacity) capacity *= 2;
+        buffer->data = (char *)realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+}
+
+static inline void
+bufferAppend(OutputBuffer *buffer, const void *data, size_t size) {
+    bufferReserve(buffer, size);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static inline void
+outputChars(const char *chars, size_t length) {
+    bufferAppend(&output, chars, length);
+}
+
+static inline void
+outputString(const char *str) {
+    outputChars(str, strlen(str));
+}
+
+static void
+outputInt(long long value) {
+    char digits[24];
+    int count = 0;
+
+    unsigned long long magnitude = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[sizeof(digits) - 1 - count++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) {
+        digits[sizeof(digits) - 1 - count++] = '-';
+    }
+
+    outputChars(digits + sizeof(digits) - count, count);
+}
+
+static void
+outputHex(unsigned long long value) {
+    char digits[16];
+    int count = 0;
+
+    do {
+        digits[sizeof(digits) - 1 - count++] = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value);
+
+    outputChars(digits + sizeof(digits) - count, count);
+}
+
+/*
+ * A printf replacement for the generators that only understands %s, %.*s, %d, %lld, %llx and %%, which is all they use.
+ */
+static void
+outputf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    const char *at = format;
+    while (*at) {
+        const char *run = at;
+        while (*at && *at != '%') at++;
+        if (at > run) outputChars(run, at - run);
+        if (!*at) break;
+
+        at++;
+        if (at[0] == 's') {
+            outputString(va_arg(args, const char *));
+            at++;
+        } else if (at[0] == '.' && at[1] == '*' && at[2] == 's') {
+            int length = va_arg(args, int);
+            outputChars(va_arg(args, const char *), length);
+            at += 3;
+        } else if (at[0] == 'd') {
+            outputInt(va_arg(args, int));
+            at++;
+        } else if (at[0] == 'l' && at[1] == 'l' && at[2] == 'd') {
+            outputInt(va_arg(args, long long));
+            at += 3;
+        } else if (at[0] == 'l' && at[1] == 'l' && at[2] == 'x') {
+            outputHex(va_arg(args, unsigned long long));
+            at += 3;
+        } else if (at[0] == '%') {
+            outputChars("%", 1);
+            at++;
+        } else {
+            fatal("Unsupported output format \"%s\"\n", format);
+        }
+    }
+
+    va_end(args);
+}
+
+static void
+writeAll(int fd, const char *data, size_t size, const char *fileName) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) 
+            fatal("Could not write to %s\n", fileName);
+        data += written;
+        size -= written;
+    }
+}
+
+static bool
+fileHasContents(const char *fileName, const char *data, size_t size) {
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || (size_t)fileStat.st_size != size) {
+        return false;
+    }
+
+    FileData existing = openFile(fileName);
+    bool same = existing.size == size && memcmp(existing.data, data, size) == 0;
+    closeFile(&existing);
+
+    return same;
+}
+
+/*
+ * Writes to a temporary and renames it into place so readers never see a partially written file.
+ */
+static void
+writeFile(const char *fileName, const char *data, size_t size) {
+    size_t nameLength = strlen(fileName);
+    char *tempName = (char *)malloc(nameLength + 32);
+    snprintf(tempName, nameLength + 32, "%s.tmp%d", fileName, (int)getpid());
+
+    int fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) 
+        fatal("Could not open %s for writing\n", tempName);
+
+    writeAll(fd, data, size, tempName);
+    close(fd);
+
+    if (rename(tempName, fileName) != 0) {
+        unlink(tempName);
+        fatal("Could not rename %s to %s\n", tempName, fileName);
+    }
+
+    free(tempName);
+}
+
+/*
+ * Writes the output buffer to stdout, or to fileName if given. With onlyIfChanged an output file that already has
+ * identical contents is left alone so its timestamp doesn't change.
+ */
+static void
+flushOutput(const char *fileName, bool onlyIfChanged) {
+    phaseStats.outputFileCount++;
+    phaseStats.outputBytes += output.size;
+
+    if (!fileName) {
+        phaseStats.writtenBytes += output.size;
+        writeAll(STDOUT_FILENO, output.data, output.size, "<stdout>");
+        return;
+    }
+
+    if (onlyIfChanged && fileHasContents(fileName, output.data, output.size)) {
+        return;
+    }
+
+    writeFile(fileName, output.data, output.size);
+    phaseStats.writtenBytes += output.size;
+}
+
+/*
+ * Output generation
+ */
+
+static void
+outputIntArray(const char *type, const char *name, const int *values, int count) {
+    outputf("    static const %s %s[%d] = {", type, name, count);
+    for (int i = 0; i < count; i++) {
+        outputf(i % 16 == 0 ? "\n        %d," : " %d,", values[i]);
+    }
+    outputf("\n    };\n");
+}
+
+/*
+ * How the metadata tables are emitted. A single header can just define them, split headers either define them as
+ * inline variables or only declare them, in which case the definitions go in a separate source file.
+ */
+enum TableLinkage {
+    TableLinkage_Global,
+    TableLinkage_Inline,
+    TableLinkage_Extern
+};
+
+static const char *
+tablePrefix(TableLinkage linkage) {
+    if (constTables) {
+        return linkage == TableLinkage_Inline ? "inline constexpr " : "constexpr ";
+    }
+    return linkage == TableLinkage_Inline ? "inline " : "";
+}
+
+// For declarations of the tables and pointers to them
+static const char *
+constPrefix() {
+    return constTables ? "const " : "";
+}
+
+/*
+ * One literal per name in offset order, each with its terminator spelled out.
+ */
+static void
+outputStringPool(TableLinkage linkage) {
+    if (linkage == TableLinkage_Extern) {
+        outputf("extern const char meta_strings[];\n\n");
+        return;
+    }
+
+    outputf("%schar meta_strings[%lld] =", tablePrefix(linkage), (long long)stringPool.size + 1);
+    for (int i = 0; i < stringPool.names.count; i++) {
+        String *name = &stringPool.names.entries[i].value;
+        outputf("\n    \"%.*s\\0\"", name->length, name->data);
+    }
+    outputf(";\n\n");
+}
+
+static void
+outputNameAccessor(const char *type) {
+    if (constTables) {
+        outputf("inline const char *meta_getName(const %s *meta) {\n"
+                "    return meta_strings + meta->nameOffset;\n"
+                "}\n\n", type);
+    } else {
+        outputf("inline const char *meta_getName(const %s *meta) {\n"
+                "    return meta->name;\n"
+                "}\n\n", type);
+    }
+}
+
+static void
+outputPreamble() {
+    outputf("#include <stddef.h>\n"
+           "#include <stdint.h>\n"
+           "#include <string.h>\n\n"
+           "#define meta_getMemberPtr(s, m) (void *)(((intptr_t)&(s)) + (m)->offset)\n"
+		   "#define meta_isArray(m) (((m)->flags & (Meta_StructMember_Flags_Array)) > 0)\n"
+		   "#define meta_isPointer(m) (((m)->flags & (Meta_StructMember_Flags_Pointer)) > 0)\n"
+           "\n"  
+           );
+
+    // Must match metaNameHash and perfectHashSlot
+    outputf("inline uint64_t meta_hashName(const char *name, int length) {\n"
+            "    uint64_t hash = 0xcbf29ce484222325ull;\n"
+            "    for (int i = 0; i < length; i++) {\n"
+            "        hash ^= (unsigned char)name[i];\n"
+            "        hash *= 0x100000001b3ull;\n"
+            "    }\n"
+            "    return hash;\n"
+            "}\n\n"
+            "inline uint32_t meta_hashSlot(uint64_t hash, uint32_t displacement, uint32_t mask) {\n"
+            "    uint64_t mixed = (hash ^ (displacement * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;\n"
+            "    return (uint32_t)(mixed >> 32) & mask;\n"
+            "}\n\n");
+}
+
+/*
+ * Member runs
+ *
+ * Generators that can treat plain members as bytes merge neighbouring ones into runs. A run is only split where
+ * offsetof shows a gap after the previous member, so padding is never touched. The offsets and sizes are all
+ * constants, so the compiler resolves the splits and each run becomes a single fixed size operation. Members that
+ * aren't plain end the current run and are handled one at a time, element by element for arrays.
+ */
+
+struct PrimitiveLayout {
+    const char *name;
+    int size;
+};
+
+static const PrimitiveLayout primitiveLayouts[] = {
+    { "char", 1 }, { "bool", 1 }, { "int8_t", 1 }, { "uint8_t", 1 },
+    { "short", 2 }, { "int16_t", 2 }, { "uint16_t", 2 }, { "char16_t", 2 },
+    { "int", 4 }, { "unsigned", 4 }, { "float", 4 }, { "int32_t", 4 }, { "uint32_t", 4 }, { "char32_t", 4 }, 
+    { "wchar_t", 4 },
+    { "long", 8 }, { "double", 8 }, { "int64_t", 8 }, { "uint64_t", 8 }, { "size_t", 8 }, { "ssize_t", 8 }, 
+    { "intptr_t", 8 }, { "uintptr_t", 8 }, { "ptrdiff_t", 8 }
+};
+
+static bool
+isPrimitiveType(Token *type) {
+    for (int i = 0; i < arrayLength(primitiveLayouts); i++) {
+        if (tokenMatchesString(type, primitiveLayouts[i].name)) return true;
+    }
+    return false;
+}
+
+static bool
+isIntrospectedStruct(StructMember *member) {
+    return !member->isPointer && stringHashFind(&structNames, &member->type.text) >= 0;
+}
+
+static bool
+isSerializePlain(StructMember *member) {
+    return !member->isPointer && !isIntrospectedStruct(member);
+}
+
+/*
+ * Outputs declarations for the functions a generator calls on the introspected structs nested in s, as those may come
+ * later in the output or from another split header.
+ */
+static void
+outputNestedStructDeclarations(Struct *s, void (*outputDeclarations)(String *type)) {
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        if (isIntrospectedStruct(member)) outputDeclarations(&member->type.text);
+    }
+}
+
+struct MemberRunGenerator {
+    Struct *s;
+    // When set plain members get a static_assert that they're trivially copyable, with this finishing the message
+    const char *plainRequirement;
+    bool (*isPlain)(StructMember *member);
+    // Outputs the code for the bytes from start to end
+    void (*outputRun)(MemberRunGenerator *generator, const char *indent);
+    // Outputs the code for a member that isn't plain. index is "[i]" for each element of an array, "" otherwise
+    void (*outputMember)(MemberRunGenerator *generator, StructMember *member, const char *index, const char *indent);
+    void *data;
+};
+
+static void
+outputMemberRuns(MemberRunGenerator *generator) {
+    String *name = &generator->s->name.text;
+    bool inRun = false;
+    bool declaredRun = false;
+
+    for (StructMember *member = generator->s->firstMember; member; member = member->next) {
+        String *memberName = &member->name.text;
+
+        if (generator->isPlain(member)) {
+            if (generator->plainRequirement) {
+                outputf("    static_assert(std::is_trivially_copyable<decltype(%.*s::%.*s)>::value, "
+                        "\"%.*s::%.*s must be trivially copyable to be %s\");\n",
+                        name->length, name->data, memberName->length, memberName->data,
+                        name->length, name->data, memberName->length, memberName->data, generator->plainRequirement);
+            }
+
+            if (!declaredRun) {
+                outputf("    size_t start, end;\n");
+                declaredRun = true;
+            }
+
+            if (inRun) {
+                // Constant, so this either disappears or splits the run around padding
+                outputf("    if (offsetof(%.*s, %.*s) != end) {\n", name->length, name->data, 
+                        memberName->length, memberName->data);
+                generator->outputRun(generator, "        ");
+                outputf("        start = offsetof(%.*s, %.*s);\n"
+                        "    }\n", name->length, name->data, memberName->length, memberName->data);
+            } else {
+                outputf("    start = offsetof(%.*s, %.*s);\n", name->length, name->data, 
+                        memberName->length, memberName->data);
+                inRun = true;
+            }
+
+            outputf("    end = offsetof(%.*s, %.*s) + sizeof(%.*s::%.*s);\n", name->length, name->data, 
+                    memberName->length, memberName->data, name->length, name->data, 
+                    memberName->length, memberName->data);
+            continue;
+        }
+
+        if (inRun) {
+            generator->outputRun(generator, "    ");
+            inRun = false;
+        }
+
+        if (member->isArray) {
+            outputf("    for (size_t i = 0; i < sizeof(%.*s::%.*s) / sizeof(%.*s::%.*s[0]); i++) {\n",
+                    name->length, name->data, memberName->length, memberName->data, 
+                    name->length, name->data, memberName->length, memberName->data);
+            generator->outputMember(generator, member, "[i]", "        ");
+            outputf("    }\n");
+        } else {
+            generator->outputMember(generator, member, "", "    ");
+        }
+    }
+
+    if (inRun) {
+        generator->outputRun(generator, "    ");
+    }
+}
+
+/*
+ * Serialization
+ *
+ * Serializers copy members straight out of the struct, each run of plain members with one memcpy. Pointers and nested
+ * introspected structs are handled on their own.
+ */
+
+static void
+outputSerializerDefinitions() {
+    outputf("#include <stdlib.h>\n"
+            "#include <type_traits>\n\n"
+            "struct Meta_Writer {\n"
+            "    unsigned char *data;\n"
+            "    size_t size;\n"
+            "    size_t capacity;\n"
+            "};\n\n"
+            "struct Meta_Reader {\n"
+            "    const unsigned char *data;\n"
+            "    size_t size;\n"
+            "    size_t position;\n"
+            "    bool failed;\n"
+            "};\n\n"
+            "inline void meta_growWriter(Meta_Writer *writer, size_t size) {\n"
+            "    size_t capacity = writer->capacity ? writer->capacity * 2 : 256;\n"
+            "    while (capacity < writer->size + size) capacity *= 2;\n"
+            "    writer->data = (unsigned char *)realloc(writer->data, capacity);\n"
+            "    writer->capacity = capacity;\n"
+            "}\n\n"
+            "inline void meta_writeBytes(Meta_Writer *writer, const void *data, size_t size) {\n"
+            "    if (writer->capacity - writer->size < size) meta_growWriter(writer, size);\n"
+            "    memcpy(writer->data + writer->size, data, size);\n"
+            "    writer->size += size;\n"
+            "}\n\n"
+            "inline bool meta_readBytes(Meta_Reader *reader, void *data, size_t size) {\n"
+            "    if (reader->failed || reader->size - reader->position < size) {\n"
+            "        reader->failed = true;\n"
+            "        return false;\n"
+            "    }\n"
+            "    memcpy(data, reader->data + reader->position, size);\n"
+            "    reader->position += size;\n"
+            "    return true;\n"
+            "}\n\n");
+
+    // Strings are the one pointer we know how to handle, everything else needs an overload from the user
+    outputf("template <typename Writer>\n"
+            "inline void meta_serializePointer(Writer *writer, const char *value) {\n"
+            "    uint32_t length = value ? (uint32_t)strlen(value) : UINT32_MAX;\n"
+            "    meta_writeBytes(writer, &length, sizeof(length));\n"
+            "    if (value) meta_writeBytes(writer, value, length);\n"
+            "}\n\n"
+            "template <typename Reader>\n"
+            "inline void meta_deserializePointer(Reader *reader, char **value) {\n"
+            "    uint32_t length;\n"
+            "    *value = nullptr;\n"
+            "    if (!meta_readBytes(reader, &length, sizeof(length)) || length == UINT32_MAX) return;\n"
+            "    if (reader->size - reader->position < length) {\n"
+            "        reader->failed = true;\n"
+            "        return;\n"
+            "    }\n"
+            "    *value = (char *)malloc(length + 1);\n"
+            "    meta_readBytes(reader, *value, length);\n"
+            "    (*value)[length] = '\\0';\n"
+            "}\n\n");
+}
+
+/*
+ * Hashing
+ *
+ * meta_hash and meta_equals only look at member bytes, never padding. Runs of plain members (built in types, enums
+ * and pointers other than char *, which is compared as a string) are hashed a word at a time and compared with one
+ * memcmp, so floats compare bitwise. Nested introspected structs use their own functions, and members of any other
+ * type need meta_hash and meta_equals overloads from the user.
+ */
+
+static void
+outputHashDefinitions() {
+    outputf("inline uint64_t meta_hashMix(uint64_t hash, uint64_t value) {\n"
+            "    hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;\n"
+            "    return hash ^ (hash >> 29);\n"
+            "}\n\n"
+            "inline uint64_t meta_hashBytes(uint64_t hash, const void *data, size_t size) {\n"
+            "    const unsigned char *bytes = (const unsigned char *)data;\n"
+            "    for (; size >= 8; bytes += 8, size -= 8) {\n"
+            "        uint64_t word;\n"
+            "        memcpy(&word, bytes, 8);\n"
+            "        hash = meta_hashMix(hash, word);\n"
+            "    }\n"
+            "    if (size) {\n"
+            "        uint64_t word = 0;\n"
+            "        memcpy(&word, bytes, size);\n"
+            "        hash = meta_hashMix(hash, word ^ ((uint64_t)size << 56));\n"
+            "    }\n"
+            "    return hash;\n"
+            "}\n\n"
+            "inline uint64_t meta_hashFinish(uint64_t hash) {\n"
+            "    hash ^= hash >> 32;\n"
+            "    hash *= 0xd6e8feb86659fd93ull;\n"
+            "    return hash ^ (hash >> 32);\n"
+            "}\n\n"
+            "inline uint64_t meta_hashString(uint64_t hash, const char *value) {\n"
+            "    if (!value) return meta_hashMix(hash, 0x5bd1e995ull);\n"
+            "    size_t length = strlen(value);\n"
+            "    return meta_hashMix(meta_hashBytes(hash, value, length), length);\n"
+            "}\n\n"
+            "// For hash containers, e.g. std::unordered_map<Key, Value, Meta_Hash, Meta_Equals>\n"
+            "struct Meta_Hash {\n"
+            "    template <typename T>\n"
+            "    size_t operator()(const T &value) const { return (size_t)meta_hash(value); }\n"
+            "};\n\n"
+            "struct Meta_Equals {\n"
+            "    template <typename T>\n"
+            "    bool operator()(const T &a, const T &b) const { return meta_equals(a, b); }\n"
+            "};\n\n");
+}
+
+static bool
+isStringMember(StructMember *member) {
+    return member->isPointer && tokenMatchesString(&member->type, "char");
+}
+
+static bool
+isHashPlain(StructMember *member) {
+    if (member->isPointer) return !isStringMember(member);
+    return isPrimitiveType(&member->type) || stringHashFind(&enumNames, &member->type.text) >= 0;
+}
+
+static void
+outputHashRun(MemberRunGenerator *generator, const char *indent) {
+    outputf("%shash = meta_hashBytes(hash, (const char *)&s + start, end - start);\n", indent);
+}
+
+static void
+outputHashMember(MemberRunGenerator *generator, StructMember *member, const char *index, const char *indent) {
+    if (isStringMember(member)) {
+        outputf("%shash = meta_hashString(hash, s.%.*s%s);\n", indent, 
+                member->name.text.length, member->name.text.data, index);
+    } else {
+        outputf("%shash = meta_hash(s.%.*s%s, hash);\n", indent, member->name.text.length, member->name.text.data, index);
+    }
+}
+
+static void
+outputEqualsRun(MemberRunGenerator *generator, const char *indent) {
+    outputf("%sif (memcmp((const char *)&a + start, (const char *)&b + start, end - start) != 0) return false;\n", indent);
+}
+
+static void
+outputEqualsMember(MemberRunGenerator *generator, StructMember *member, const char *index, const char *indent) {
+    String *memberName = &member->name.text;
+    outputf("%sif (!%s(a.%.*s%s, b.%.*s%s)) return false;\n", indent, 
+            isStringMember(member) ? "meta_stringEquals" : "meta_equals",
+            memberName->length, memberName->data, index, memberName->length, memberName->data, index);
+}
+
+static void
+outputHashDeclarations(String *type) {
+    outputf("inline uint64_t meta_hash(const %.*s &s, uint64_t seed);\n"
+            "inline bool meta_equals(const %.*s &a, const %.*s &b);\n",
+            type->length, type->data, type->length, type->data, type->length, type->data);
+}
+
+static void
+outputHashFunctions(Struct *s) {
+    String *name = &s->name.text;
+
+    outputNestedStructDeclarations(s, outputHashDeclarations);
+
+    MemberRunGenerator generator = {};
+    generator.s = s;
+    generator.isPlain = isHashPlain;
+
+    outputf("inline uint64_t meta_hash(const %.*s &s, uint64_t seed = 0) {\n"
+            "    uint64_t hash = seed;\n", name->length, name->data);
+    generator.outputRun = outputHashRun;
+    generator.outputMember = outputHashMember;
+    outputMemberRuns(&generator);
+    outputf("    return meta_hashFinish(hash);\n"
+            "}\n\n");
+
+    outputf("inline bool meta_equals(const %.*s &a, const %.*s &b) {\n", 
+            name->length, name->data, name->length, name->data);
+    generator.outputRun = outputEqualsRun;
+    generator.outputMember = outputEqualsMember;
+    outputMemberRuns(&generator);
+    outputf("    return true;\n"
+            "}\n\n");
+}
+
+/*
+ * Deltas
+ *
+ * For replicating state that mostly doesn't change. meta_isUnchanged compares the struct run by run like meta_equals,
+ * so an unchanged struct costs a few wide compares. Only if that fails does meta_diff compare member by member to
+ * build a bitmask of the changed members, with bit i for the i'th member. Deltas are the mask followed by just the
+ * changed members, written like the serializer writes them. Pointers other than char * are compared by value.
+ */
+
+static void
+outputDeltaDefinitions() {
+    outputf("template <int Words>\n"
+            "struct Meta_ChangeMask {\n"
+            "    uint64_t words[Words];\n"
+            "};\n\n"
+            "template <int Words>\n"
+            "inline bool meta_isChanged(const Meta_ChangeMask<Words> &mask, int index) {\n"
+            "    return (mask.words[index / 64] >> (index %% 64)) & 1;\n"
+            "}\n\n"
+            "template <int Words>\n"
+            "inline void meta_setChanged(Meta_ChangeMask<Words> *mask, int index) {\n"
+            "    mask->words[index / 64] |= 1ull << (index %% 64);\n"
+            "}\n\n"
+            "template <int Words>\n"
+            "inline bool meta_anyChanged(const Meta_ChangeMask<Words> &mask) {\n"
+            "    for (int i = 0; i < Words; i++) {\n"
+            "        if (mask.words[i]) return true;\n"
+            "    }\n"
+            "    return false;\n"
+            "}\n\n");
+}
+
+static const char *
+deltaCompareFunction(StructMember *member) {
+    if (isIntrospectedStruct(member)) return "meta_isUnchanged";
+    if (isStringMember(member)) return "meta_stringEquals";
+    return nullptr;
+}
+
+static void
+outputDeltaEqualsMember(MemberRunGenerator *generator, StructMember *member, const char *index, const char *indent) {
+    String *memberName = &member->name.text;
+    const char *function = deltaCompareFunction(member);
+
+    if (function) {
+        outputf("%sif (!%s(a.%.*s%s, b.%.*s%s)) return false;\n", indent, function,
+                memberName->length, memberName->data, index, memberName->length, memberName->data, index);
+    } else {
+        outputf("%sif (a.%.*s%s != b.%.*s%s) return false;\n", indent,
+                memberName->length, memberName->data, index, memberName->length, memberName->data, index);
+    }
+}
+
+static void
+outputDeltaDeclarations(String *type) {
+    outputf("inline bool meta_isUnchanged(const %.*s &a, const %.*s &b);\n", type->length, type->data, type->length, type->data);
+}
+
+static void
+outputDeltaFunctions(Struct *s) {
+    String *name = &s->name.text;
+    int words = s->memberCount > 64 ? (s->memberCount + 63) / 64 : 1;
+
+    outputf("enum Meta_%.*s_Member {\n", name->length, name->data);
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        outputf("    Meta_%.*s_Member_%.*s,\n", name->length, name->data, member->name.text.length, member->name.text.data);
+    }
+    outputf("};\n\n");
+
+    outputNestedStructDeclarations(s, outputDeltaDeclarations);
+
+    outputf("inline bool meta_isUnchanged(const %.*s &a, const %.*s &b) {\n", 
+            name->length, name->data, name->length, name->data);
+    MemberRunGenerator generator = {};
+    generator.s = s;
+    generator.plainRequirement = "delta encoded";
+    generator.isPlain = isSerializePlain;
+    generator.outputRun = outputEqualsRun;
+    generator.outputMember = outputDeltaEqualsMember;
+    outputMemberRuns(&generator);
+    outputf("    return true;\n"
+            "}\n\n");
+
+    outputf("inline Meta_ChangeMask<%d> meta_diff(const %.*s &previous, const %.*s &current) {\n"
+            "    Meta_ChangeMask<%d> changed = {};\n"
+            "    if (meta_isUnchanged(previous, current)) return changed;\n", 
+            words, name->length, name->data, name->length, name->data, words);
+
+    int index = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next, index++) {
+        String *memberName = &member->name.text;
+        const char *function = deltaCompareFunction(member);
+
+        if (isSerializePlain(member)) {
+            outputf("    if (memcmp(&previous.%.*s, &current.%.*s, sizeof(previous.%.*s)) != 0) ", 
+                    memberName->length, memberName->data, memberName->length, memberName->data, 
+                    memberName->length, memberName->data);
+        } else if (member->isArray) {
+            outputf("    for (size_t i = 0; i < sizeof(%.*s::%.*s) / sizeof(%.*s::%.*s[0]); i++) {\n", 
+                    name->length, name->data, memberName->length, memberName->data, 
+                    name->length, name->data, memberName->length, memberName->data);
+            if (function) {
+                outputf("        if (!%s(previous.%.*s[i], current.%.*s[i])) ", function,
+                        memberName->length, memberName->data, memberName->length, memberName->data);
+            } else {
+                outputf("        if (previous.%.*s[i] != current.%.*s[i]) ", 
+                        memberName->length, memberName->data, memberName->length, memberName->data);
+            }
+            outputf("meta_setChanged(&changed, %d);\n"
+                    "    }\n", index);
+            continue;
+        } else if (function) {
+            outputf("    if (!%s(previous.%.*s, current.%.*s)) ", function,
+                    memberName->length, memberName->data, memberName->length, memberName->data);
+        } else {
+            outputf("    if (previous.%.*s != current.%.*s) ", 
+                    memberName->length, memberName->data, memberName->length, memberName->data);
+        }
+        outputf("meta_setChanged(&changed, %d);\n", index);
+    }
+
+    outputf("    return changed;\n"
+            "}\n\n");
+
+    outputf("template <typename Writer>\n"
+            "inline Meta_ChangeMask<%d> meta_encodeDelta(Writer *writer, const %.*s &previous, const %.*s &current) {\n"
+            "    Meta_ChangeMask<%d> changed = meta_diff(previous, current);\n"
+            "    meta_writeBytes(writer, changed.words, sizeof(changed.words));\n", 
+            words, name->length, name->data, name->length, name->data, words);
+
+    index = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next, index++) {
+        String *memberName = &member->name.text;
+        outputf("    if (meta_isChanged(changed, %d)) {\n", index);
+
+        if (isSerializePlain(member)) {
+            outputf("        meta_writeBytes(writer, &current.%.*s, sizeof(current.%.*s));\n", 
+                    memberName->length, memberName->data, memberName->length, memberName->data);
+        } else {
+            const char *element = member->isArray ? "[i]" : "";
+            const char *indent = member->isArray ? "            " : "        ";
+            if (member->isArray) {
+                outputf("        for (size_t i = 0; i < sizeof(%.*s::%.*s) / sizeof(%.*s::%.*s[0]); i++) {\n", 
+                        name->length, name->data, memberName->length, memberName->data, 
+                        name->length, name->data, memberName->length, memberName->data);
+            }
+            if (isIntrospectedStruct(member)) {
+                outputf("%smeta_encodeDelta(writer, previous.%.*s%s, current.%.*s%s);\n", indent, 
+                        memberName->length, memberName->data, element, memberName->length, memberName->data, element);
+            } else {
+                outputf("%smeta_serializePointer(writer, current.%.*s%s);\n", indent, 
+                        memberName->length, memberName->data, element);
+            }
+            if (member->isArray) {
+                outputf("        }\n");
+            }
+        }
+
+        outputf("    }\n");
+    }
+
+    outputf("    return changed;\n"
+            "}\n\n");
+
+    outputf("template <typename Reader>\n"
+            "inline bool meta_applyDelta(Reader *reader, %.*s *state) {\n"
+            "    Meta_ChangeMask<%d> changed;\n"
+            "    if (!meta_readBytes(reader, changed.words, sizeof(changed.words))) return false;\n", 
+            name->length, name->data, words);
+
+    index = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next, index++) {
+        String *memberName = &member->name.text;
+        outputf("    if (meta_isChanged(changed, %d)) {\n", index);
+
+        if (isSerializePlain(member)) {
+            outputf("        meta_readBytes(reader, &state->%.*s, sizeof(state->%.*s));\n", 
+                    memberName->length, memberName->data, memberName->length, memberName->data);
+        } else {
+            const char *element = member->isArray ? "[i]" : "";
+            const char *indent = member->isArray ? "            " : "        ";
+            if (member->isArray) {
+                outputf("        for (size_t i = 0; i < sizeof(%.*s::%.*s) / sizeof(%.*s::%.*s[0]); i++) {\n", 
+                        name->length, name->data, memberName->length, memberName->data, 
+                        name->length, name->data, memberName->length, memberName->data);
+            }
+            outputf("%s%s(reader, &state->%.*s%s);\n", indent, 
+                    isIntrospectedStruct(member) ? "meta_applyDelta" : "meta_deserializePointer",
+                    memberName->length, memberName->data, element);
+            if (member->isArray) {
+                outputf("        }\n");
+            }
+        }
+
+        outputf("    }\n");
+    }
+
+    outputf("    return !reader->failed;\n"
+            "}\n\n");
+}
+
+/*
+ * JSON
+ *
+ * Writers go straight into a buffer supplied by the caller, with each key and its punctuation written as one literal
+ * so a flat struct is mostly fixed size copies. Readers find members through a perfect hash of their names, built
+ * here like the one behind meta_fromName, and enums reuse meta_getName and meta_fromName. Members the generated code
+ * has no overload for need one from the user, non char pointers are left out.
+ */
+
+static void
+outputJsonDefinitions() {
+    outputf("#include <errno.h>\n"
+            "#include <math.h>\n"
+            "#include <stdio.h>\n"
+            "#include <stdlib.h>\n"
+            "#include <limits>\n"
+            "#include <type_traits>\n\n");
+
+    outputf("struct Meta_JsonWriter {\n"
+            "    char *data;\n"
+            "    size_t size;\n"
+            "    size_t capacity;\n"
+            "    bool overflow;\n"
+            "};\n"
+            "\n"
+            "struct Meta_JsonReader {\n"
+            "    const char *at;\n"
+            "    const char *end;\n"
+            "    bool failed;\n"
+            "};\n"
+            "\n"
+            "inline void meta_jsonWriteRaw(Meta_JsonWriter *writer, const char *data, size_t size) {\n"
+            "    if (writer->capacity - writer->size < size) {\n"
+            "        writer->overflow = true;\n"
+            "        return;\n"
+            "    }\n"
+            "    memcpy(writer->data + writer->size, data, size);\n"
+            "    writer->size += size;\n"
+            "}\n"
+            "\n"
+            "inline void meta_jsonWriteString(Meta_JsonWriter *writer, const char *value, size_t length) {\n"
+            "    static const char hexDigits[] = \"0123456789abcdef\";\n"
+            "    meta_jsonWriteRaw(writer, \"\\\"\", 1);\n"
+            "    size_t start = 0;\n"
+            "    for (size_t i = 0; i < length; i++) {\n"
+            "        unsigned char c = (unsigned char)value[i];\n"
+            "        if (c >= 0x20 && c != '\"' && c != '\\\\') continue;\n"
+            "        meta_jsonWriteRaw(writer, value + start, i - start);\n"
+            "        char escape[6] = { '\\\\', (char)c, 0, 0, 0, 0 };\n"
+            "        size_t escapeLength = 2;\n"
+            "        if (c == '\\n') escape[1] = 'n';\n"
+            "        else if (c == '\\r') escape[1] = 'r';\n"
+            "        else if (c == '\\t') escape[1] = 't';\n"
+            "        else if (c < 0x20) {\n"
+            "            escape[1] = 'u';\n"
+            "            escape[2] = '0';\n"
+            "            escape[3] = '0';\n"
+            "            escape[4] = hexDigits[c >> 4];\n"
+            "            escape[5] = hexDigits[c & 15];\n"
+            "            escapeLength = 6;\n"
+            "        }\n"
+            "        meta_jsonWriteRaw(writer, escape, escapeLength);\n"
+            "        start = i + 1;\n"
+            "    }\n"
+            "    meta_jsonWriteRaw(writer, value + start, length - start);\n"
+            "    meta_jsonWriteRaw(writer, \"\\\"\", 1);\n"
+            "}\n"
+            "\n"
+            "inline void meta_jsonWriteInteger(Meta_JsonWriter *writer, unsigned long long value, bool negative) {\n"
+            "    char digits[24];\n"
+            "    char *at = digits + sizeof(digits);\n"
+            "    do {\n"
+            "        *--at = (char)('0' + value %% 10);\n"
+            "        value /= 10;\n"
+            "    } while (value);\n"
+            "    if (negative) *--at = '-';\n"
+            "    meta_jsonWriteRaw(writer, at, digits + sizeof(digits) - at);\n"
+            "}\n"
+            "\n"
+            "template <typename T>\n"
+            "inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type\n"
+            "meta_writeJson(Meta_JsonWriter *writer, T value) {\n"
+            "    if (std::is_signed<T>::value && value < 0) {\n"
+            "        meta_jsonWriteInteger(writer, 0ull - (unsigned long long)value, true);\n"
+            "    } else {\n"
+            "        meta_jsonWriteInteger(writer, (unsigned long long)value, false);\n"
+            "    }\n"
+            "}\n"
+            "\n"
+            "inline void meta_writeJson(Meta_JsonWriter *writer, bool value) {\n"
+            "    if (value) meta_jsonWriteRaw(writer, \"true\", 4);\n"
+            "    else meta_jsonWriteRaw(writer, \"false\", 5);\n"
+            "}\n"
+            "\n"
+            "inline void meta_jsonWriteFloat(Meta_JsonWriter *writer, double value, int precision) {\n"
+            "    if (!isfinite(value)) {\n"
+            "        meta_jsonWriteRaw(writer, \"null\", 4);\n"
+            "        return;\n"
+            "    }\n"
+            "    char buffer[32];\n"
+            "    int length = snprintf(buffer, sizeof(buffer), \"%%.*g\", precision, value);\n"
+            "    meta_jsonWriteRaw(writer, buffer, length);\n"
+            "}\n"
+            "\n"
+            "inline void meta_writeJson(Meta_JsonWriter *writer, float value) {\n"
+            "    meta_jsonWriteFloat(writer, value, 9);\n"
+            "}\n"
+            "\n"
+            "inline void meta_writeJson(Meta_JsonWriter *writer, double value) {\n"
+            "    meta_jsonWriteFloat(writer, value, 17);\n"
+            "}\n"
+            "\n"
+            "inline void meta_writeJson(Meta_JsonWriter *writer, const char *value) {\n"
+            "    if (value) meta_jsonWriteString(writer, value, strlen(value));\n"
+            "    else meta_jsonWriteRaw(writer, \"null\", 4);\n"
+            "}\n\n");
+
+    outputf("inline bool meta_jsonFail(Meta_JsonReader *reader) {\n"
+            "    reader->failed = true;\n"
+            "    reader->at = reader->end;\n"
+            "    return false;\n"
+            "}\n"
+            "\n"
+            "inline void meta_jsonSkipWhitespace(Meta_JsonReader *reader) {\n"
+            "    while (reader->at < reader->end && (*reader->at == ' ' || *reader->at == '\\t' || *reader->at == '\\n' || *reader->at == '\\r')) {\n"
+            "        reader->at++;\n"
+            "    }\n"
+            "}\n"
+            "\n"
+            "inline bool meta_jsonConsume(Meta_JsonReader *reader, char c) {\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    if (reader->at < reader->end && *reader->at == c) {\n"
+            "        reader->at++;\n"
+            "        return true;\n"
+            "    }\n"
+            "    return false;\n"
+            "}\n"
+            "\n"
+            "inline bool meta_jsonExpect(Meta_JsonReader *reader, char c) {\n"
+            "    return meta_jsonConsume(reader, c) || meta_jsonFail(reader);\n"
+            "}\n"
+            "\n"
+            "inline bool meta_jsonConsumeLiteral(Meta_JsonReader *reader, const char *literal, size_t length) {\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    if ((size_t)(reader->end - reader->at) < length || memcmp(reader->at, literal, length) != 0) return false;\n"
+            "    reader->at += length;\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "// The raw contents of a string, escapes and all\n"
+            "inline bool meta_jsonReadRawString(Meta_JsonReader *reader, const char **data, size_t *length) {\n"
+            "    if (!meta_jsonExpect(reader, '\"')) return false;\n"
+            "    const char *start = reader->at;\n"
+            "    while (reader->at < reader->end && *reader->at != '\"') {\n"
+            "        if (*reader->at == '\\\\') reader->at++;\n"
+            "        reader->at++;\n"
+            "    }\n"
+            "    if (reader->at >= reader->end) return meta_jsonFail(reader);\n"
+            "    *data = start;\n"
+            "    *length = reader->at - start;\n"
+            "    reader->at++;\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "inline bool meta_jsonReadKey(Meta_JsonReader *reader, const char **key, size_t *length) {\n"
+            "    return meta_jsonReadRawString(reader, key, length) && meta_jsonExpect(reader, ':');\n"
+            "}\n"
+            "\n"
+            "inline int meta_jsonHexDigit(char c) {\n"
+            "    if (c >= '0' && c <= '9') return c - '0';\n"
+            "    if (c >= 'a' && c <= 'f') return c - 'a' + 10;\n"
+            "    if (c >= 'A' && c <= 'F') return c - 'A' + 10;\n"
+            "    return -1;\n"
+            "}\n"
+            "\n"
+            "// Never writes more than length bytes, or capacity if that's smaller\n"
+            "inline size_t meta_jsonUnescape(const char *data, size_t length, char *out, size_t capacity) {\n"
+            "    size_t size = 0;\n"
+            "    for (size_t i = 0; i < length && size < capacity; i++) {\n"
+            "        char c = data[i];\n"
+            "        if (c != '\\\\' || i + 1 >= length) {\n"
+            "            out[size++] = c;\n"
+            "            continue;\n"
+            "        }\n"
+            "        c = data[++i];\n"
+            "        if (c == 'n') out[size++] = '\\n';\n"
+            "        else if (c == 'r') out[size++] = '\\r';\n"
+            "        else if (c == 't') out[size++] = '\\t';\n"
+            "        else if (c == 'b') out[size++] = '\\b';\n"
+            "        else if (c == 'f') out[size++] = '\\f';\n"
+            "        else if (c != 'u') out[size++] = c;\n"
+            "        else {\n"
+            "            unsigned int code = 0;\n"
+            "            for (int digit = 0; digit < 4 && i + 1 < length; digit++) {\n"
+            "                int value = meta_jsonHexDigit(data[++i]);\n"
+            "                code = code * 16 + (value < 0 ? 0 : value);\n"
+            "            }\n"
+            "            char utf8[4];\n"
+            "            size_t utf8Length;\n"
+            "            if (code < 0x80) {\n"
+            "                utf8[0] = (char)code;\n"
+            "                utf8Length = 1;\n"
+            "            } else if (code < 0x800) {\n"
+            "                utf8[0] = (char)(0xc0 | (code >> 6));\n"
+            "                utf8[1] = (char)(0x80 | (code & 0x3f));\n"
+            "                utf8Length = 2;\n"
+            "            } else {\n"
+            "                utf8[0] = (char)(0xe0 | (code >> 12));\n"
+            "                utf8[1] = (char)(0x80 | ((code >> 6) & 0x3f));\n"
+            "                utf8[2] = (char)(0x80 | (code & 0x3f));\n"
+            "                utf8Length = 3;\n"
+            "            }\n"
+            "            for (size_t k = 0; k < utf8Length && size < capacity; k++) out[size++] = utf8[k];\n"
+            "        }\n"
+            "    }\n"
+            "    return size;\n"
+            "}\n"
+            "\n"
+            "inline bool meta_jsonSkipValue(Meta_JsonReader *reader) {\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    if (reader->at >= reader->end) return meta_jsonFail(reader);\n"
+            "\n"
+            "    const char *data;\n"
+            "    size_t length;\n"
+            "    if (*reader->at == '\"') return meta_jsonReadRawString(reader, &data, &length);\n"
+            "\n"
+            "    if (*reader->at == '{' || *reader->at == '[') {\n"
+            "        int depth = 0;\n"
+            "        do {\n"
+            "            char c = *reader->at;\n"
+            "            if (c == '\"') {\n"
+            "                if (!meta_jsonReadRawString(reader, &data, &length)) return false;\n"
+            "                continue;\n"
+            "            }\n"
+            "            if (c == '{' || c == '[') depth++;\n"
+            "            else if (c == '}' || c == ']') depth--;\n"
+            "            reader->at++;\n"
+            "        } while (depth > 0 && reader->at < reader->end);\n"
+            "        return depth == 0 || meta_jsonFail(reader);\n"
+            "    }\n"
+            "\n"
+            "    const char *start = reader->at;\n"
+            "    while (reader->at < reader->end && *reader->at != ',' && *reader->at != '}' && *reader->at != ']' &&\n"
+            "           *reader->at != ' ' && *reader->at != '\\t' && *reader->at != '\\n' && *reader->at != '\\r') {\n"
+            "        reader->at++;\n"
+            "    }\n"
+            "    return reader->at != start || meta_jsonFail(reader);\n"
+            "}\n"
+            "\n"
+            "// Copies a number into buffer so it can be handed to strtod and friends\n"
+            "inline bool meta_jsonReadNumber(Meta_JsonReader *reader, char *buffer, size_t capacity) {\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    size_t length = 0;\n"
+            "    while (reader->at < reader->end && length + 1 < capacity) {\n"
+            "        char c = *reader->at;\n"
+            "        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) break;\n"
+            "        buffer[length++] = c;\n"
+            "        reader->at++;\n"
+            "    }\n"
+            "    buffer[length] = '\\0';\n"
+            "    return length > 0 || meta_jsonFail(reader);\n"
+            "}\n"
+            "\n"
+            "// Whether the integer with this sign and magnitude can be stored in a T\n"
+            "template <typename T>\n"
+            "inline bool meta_jsonIntegerFits(bool negative, unsigned long long magnitude) {\n"
+            "    unsigned long long max = (unsigned long long)std::numeric_limits<T>::max();\n"
+            "    if (!negative || magnitude == 0) return magnitude <= max;\n"
+            "    return std::is_signed<T>::value && magnitude - 1 <= max;\n"
+            "}\n"
+            "\n"
+            "// Fails on values that don't fit in T and on ones with a fraction, an exponent is fine if the value is whole\n"
+            "template <typename T>\n"
+            "inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type\n"
+            "meta_readJson(Meta_JsonReader *reader, T *value) {\n"
+            "    // Plain integers are parsed in place, anything longer or with a fraction or exponent goes through strtoull\n"
+            "    // and strtod\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    const char *at = reader->at;\n"
+            "    bool negative = at < reader->end && *at == '-';\n"
+            "    if (negative) at++;\n"
+            "    const char *digits = at;\n"
+            "    unsigned long long magnitude = 0;\n"
+            "    while (at < reader->end && *at >= '0' && *at <= '9' && at - digits < 19) {\n"
+            "        magnitude = magnitude * 10 + (*at - '0');\n"
+            "        at++;\n"
+            "    }\n"
+            "    if (at != digits && (at == reader->end || !((*at >= '0' && *at <= '9') || *at == '.' || *at == 'e' || *at == 'E'))) {\n"
+            "        if (!meta_jsonIntegerFits<T>(negative, magnitude)) return meta_jsonFail(reader);\n"
+            "        reader->at = at;\n"
+            "        *value = (T)(negative ? 0ull - magnitude : magnitude);\n"
+            "        return true;\n"
+            "    }\n"
+            "    char buffer[64];\n"
+            "    if (!meta_jsonReadNumber(reader, buffer, sizeof(buffer))) return false;\n"
+            "    const char *number = buffer + (negative ? 1 : 0);\n"
+            "    // strtoull would take another sign and negate the value itself\n"
+            "    if (*number < '0' || *number > '9') return meta_jsonFail(reader);\n"
+            "    char *end;\n"
+            "    errno = 0;\n"
+            "    magnitude = strtoull(number, &end, 10);\n"
+            "    if (*end) {\n"
+            "        double real = strtod(number, &end);\n"
+            "        // Converting back only gives the same value for whole numbers, the range check comes first\n"
+            "        if (*end || !(real < 18446744073709551616.0) || real != (double)(unsigned long long)real) return meta_jsonFail(reader);\n"
+            "        magnitude = (unsigned long long)real;\n"
+            "    }\n"
+            "    if (errno == ERANGE || !meta_jsonIntegerFits<T>(negative, magnitude)) return meta_jsonFail(reader);\n"
+            "    *value = (T)(negative ? 0ull - magnitude : magnitude);\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "inline bool meta_readJson(Meta_JsonReader *reader, bool *value) {\n"
+            "    if (meta_jsonConsumeLiteral(reader, \"true\", 4)) *value = true;\n"
+            "    else if (meta_jsonConsumeLiteral(reader, \"false\", 5)) *value = false;\n"
+            "    else return meta_jsonFail(reader);\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "inline bool meta_readJson(Meta_JsonReader *reader, double *value) {\n"
+            "    if (meta_jsonConsumeLiteral(reader, \"null\", 4)) {\n"
+            "        *value = NAN;\n"
+            "        return true;\n"
+            "    }\n"
+            "    char buffer[64];\n"
+            "    if (!meta_jsonReadNumber(reader, buffer, sizeof(buffer))) return false;\n"
+            "    char *end;\n"
+            "    *value = strtod(buffer, &end);\n"
+            "    return *end == '\\0' || meta_jsonFail(reader);\n"
+            "}\n"
+            "\n"
+            "inline bool meta_readJson(Meta_JsonReader *reader, float *value) {\n"
+            "    double result;\n"
+            "    if (!meta_readJson(reader, &result)) return false;\n"
+            "    *value = (float)result;\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "// Allocates the string with malloc\n"
+            "inline bool meta_readJson(Meta_JsonReader *reader, char **value) {\n"
+            "    if (meta_jsonConsumeLiteral(reader, \"null\", 4)) {\n"
+            "        *value = nullptr;\n"
+            "        return true;\n"
+            "    }\n"
+            "    const char *data;\n"
+            "    size_t length;\n"
+            "    if (!meta_jsonReadRawString(reader, &data, &length)) return false;\n"
+            "    *value = (char *)malloc(length + 1);\n"
+            "    (*value)[meta_jsonUnescape(data, length, *value, length)] = '\\0';\n"
+            "    return true;\n"
+            "}\n"
+            "\n"
+            "// For char arrays, truncates to fit\n"
+            "inline bool meta_jsonReadString(Meta_JsonReader *reader, char *value, size_t capacity) {\n"
+            "    const char *data;\n"
+            "    size_t length;\n"
+            "    if (!meta_jsonReadRawString(reader, &data, &length)) return false;\n"
+            "    value[meta_jsonUnescape(data, length, value, capacity - 1)] = '\\0';\n"
+            "    return true;\n"
+            "}\n\n");
+}
+
+/*
+ * Structure of arrays
+ *
+ * Introspect(soa) structs get a companion YourStruct_SoA holding one array per member. All the arrays share a single
+ * allocation, each starting on its own cache line, so growing is one malloc and a memcpy per member. Elements are
+ * moved with memcpy, which is why every member has to be trivially copyable.
+ */
+
+static void
+outputSoaDefinitions() {
+    outputf("#include <stdlib.h>\n"
+            "#include <type_traits>\n\n"
+            "template <typename T>\n"
+            "struct Meta_Span {\n"
+            "    T *data;\n"
+            "    int count;\n\n"
+            "    T &operator[](int index) const { return data[index]; }\n"
+            "    T *begin() const { return data; }\n"
+            "    T *end() const { return data + count; }\n"
+            "};\n\n"
+            "template <typename SoA, typename T>\n"
+            "inline Meta_Span<T> meta_view(const SoA &soa, T *SoA::*member) {\n"
+            "    Meta_Span<T> span = { soa.*member, soa.count };\n"
+            "    return span;\n"
+            "}\n\n"
+            "inline size_t meta_soaArraySize(size_t elementSize, int capacity) {\n"
+            "    return (elementSize * capacity + 63) & ~(size_t)63;\n"
+            "}\n\n"
+            "// Carves the next array out of a new block and moves the existing elements into it\n"
+            "inline void *meta_soaMove(char **at, const void *from, size_t elementSize, int count, int capacity) {\n"
+            "    void *to = *at;\n"
+            "    if (count) memcpy(to, from, elementSize * count);\n"
+            "    *at += meta_soaArraySize(elementSize, capacity);\n"
+            "    return to;\n"
+            "}\n\n");
+}
+
+/*
+ * Flag enums
+ *
+ * Introspect(flags) enums are bitmasks, so meta_formatFlags breaks a value down into the names of its flags and
+ * meta_isValid checks it against the union of them. The formatter writes into a buffer from the caller rather than
+ * allocating, so it can be used for logging on hot paths.
+ */
+
+static void
+outputFlagsDefinitions() {
+    // With --const-tables each formatter has its own names, in a string pool like meta_strings
+    const char *nameField = constTables ? "uint32_t nameOffset" : "const char *name";
+    const char *namesParameter = constTables ? "const char *names, " : "";
+    const char *flagName = constTables ? "names + flags[i].nameOffset" : "flags[i].name";
+
+    outputf("struct Meta_Flag {\n"
+            "    uint64_t value;\n"
+            "    %s;\n"
+            "    int length;\n"
+            "};\n\n"
+            "// Appends as much of text as fits while leaving room for the terminator, returns the untruncated length\n"
+            "inline int meta_appendText(char *buffer, int capacity, int length, const char *text, int textLength) {\n"
+            "    int room = capacity - 1 - length;\n"
+            "    if (room > 0) memcpy(buffer + length, text, textLength < room ? textLength : room);\n"
+            "    return length + textLength;\n"
+            "}\n\n"
+            "// Returns the length of the whole string like snprintf, even if it was truncated\n"
+            "inline int meta_formatFlagValue(uint64_t value, const Meta_Flag *flags, int flagCount, %schar *buffer, int capacity) {\n"
+            "    int length = -1;\n"
+            "    for (int i = 0; i < flagCount; i++) {\n"
+            "        if (flags[i].value == value) {\n"
+            "            length = meta_appendText(buffer, capacity, 0, %s, flags[i].length);\n"
+            "            break;\n"
+            "        }\n"
+            "    }\n\n"
+            "    if (length < 0) {\n"
+            "        length = 0;\n"
+            "        uint64_t remaining = value;\n"
+            "        for (int i = 0; i < flagCount && remaining; i++) {\n"
+            "            uint64_t flag = flags[i].value;\n"
+            "            if (!flag || (remaining & flag) != flag) continue;\n"
+            "            if (length) length = meta_appendText(buffer, capacity, length, \" | \", 3);\n"
+            "            length = meta_appendText(buffer, capacity, length, %s, flags[i].length);\n"
+            "            remaining &= ~flag;\n"
+            "        }\n\n"
+            "        // Bits that aren't flags are written as a number\n"
+            "        if (remaining || !value) {\n"
+            "            char digits[18] = { '0', 'x' };\n"
+            "            int digitCount = 2;\n"
+            "            for (int shift = 60; shift >= 0; shift -= 4) {\n"
+            "                int digit = (int)(remaining >> shift) & 15;\n"
+            "                if (digit || digitCount > 2) digits[digitCount++] = \"0123456789abcdef\"[digit];\n"
+            "            }\n"
+            "            if (length) length = meta_appendText(buffer, capacity, length, \" | \", 3);\n"
+            "            if (value) length = meta_appendText(buffer, capacity, length, digits, digitCount);\n"
+            "            else length = meta_appendText(buffer, capacity, length, \"0\", 1);\n"
+            "        }\n"
+            "    }\n\n"
+            "    if (capacity > 0) buffer[length < capacity ? length : capacity - 1] = '\\0';\n"
+            "    return length;\n"
+            "}\n\n", nameField, namesParameter, flagName, flagName);
+}
+
+/*
+ * Type registry
+ *
+ * --registry generates tables for code that only has a type's name or Meta_Type at runtime, such as a scripting
+ * bridge. meta_typeRegistry is indexed by Meta_Type and points at the metadata of every introspected struct and enum,
+ * meta_memberRegistry has an entry for each of their members. Both can also be looked up by name, "YourStruct" or
+ * "YourStruct.member", through perfect hashes built at generation time.
+ */
+
+static void
+outputRegistryDefinitions() {
+    outputf("enum Meta_TypeKind {\n"
+            "    Meta_TypeKind_Other,\n"
+            "    Meta_TypeKind_Struct,\n"
+            "    Meta_TypeKind_Enum\n"
+            "};\n\n");
+
+    if (constTables) {
+        // Without pointers the metadata is found through meta_getStructMeta and friends, see outputRegistry
+        outputf("struct Meta_TypeEntry {\n"
+                "    uint32_t nameOffset;\n"
+                "    Meta_Type type;\n"
+                "    Meta_TypeKind kind;\n"
+                "};\n\n"
+                "struct Meta_MemberEntry {\n"
+                "    Meta_Type owner;\n"
+                "    int index;\n"
+                "    uint32_t nameOffset;\n"
+                "};\n\n");
+        outputNameAccessor("Meta_TypeEntry");
+        outputNameAccessor("Meta_MemberEntry");
+        return;
+    }
+
+    outputf("// The metadata pointers for the other kind are null\n"
+            "struct Meta_TypeEntry {\n"
+            "    const char *name;\n"
+            "    Meta_Type type;\n"
+            "    Meta_TypeKind kind;\n"
+            "    Meta_Struct *structMeta;\n"
+            "    Meta_StructMember *structMembers;\n"
+            "    Meta_Enum *enumMeta;\n"
+            "    Meta_EnumMember *enumMembers;\n"
+            "};\n\n"
+            "struct Meta_MemberEntry {\n"
+            "    Meta_Type owner;\n"
+            "    int index;\n"
+            "    Meta_StructMember *structMember;\n"
+            "    Meta_EnumMember *enumMember;\n"
+            "};\n\n"
+            "inline const char *meta_getName(const Meta_TypeEntry *meta) {\n"
+            "    return meta->name;\n"
+            "}\n\n"
+            "inline const char *meta_getName(const Meta_MemberEntry *meta) {\n"
+            "    return meta->structMember ? meta->structMember->name : meta->enumMember->name;\n"
+            "}\n\n");
+}
+
+static void
+outputMetaDefinitions(TableLinkage linkage) {
+    // A pointer, or with --const-tables an offset into meta_strings
+    const char *nameField = constTables ? "uint32_t nameOffset" : "const char *name";
+
+    outputf("enum Meta_StructMember_Flags {\n"
+           "    Meta_StructMember_Flags_None    = 0,\n"
+           "    Meta_StructMember_Flags_Array   = 1,\n"
+           "    Meta_StructMember_Flags_Pointer = 2\n"
+           "};\n\n");
+
+    outputf("struct Meta_Struct {\n");
+    outputf("   %s;\n", nameField); 
+    outputf("   int memberCount;\n"); 
+    outputf("   size_t size;\n"); 
+    outputf("   size_t alignment;\n"); 
+    outputf("};\n\n");
+
+    outputf("struct Meta_StructMember {\n"
+           "    %s;\n"
+           "    Meta_Type type;\n"
+           "    int flags;\n"
+           "    int arraySize;\n"
+           "    size_t offset;\n"
+           "    size_t size;\n"
+           "    size_t alignment;\n"
+           "    size_t paddingAfter;\n"
+           "};\n\n", nameField);
+
+    outputf("struct Meta_Enum {\n");
+    outputf("   %s;\n", nameField); 
+    outputf("   int memberCount;\n"); 
+    outputf("};\n\n");
+
+    outputf("struct Meta_EnumMember {\n"
+           "    %s;\n"
+           "    int value;\n"
+           "};\n\n", nameField);
+
+    if (constTables) {
+        outputStringPool(linkage);
+    }
+
+    outputNameAccessor("Meta_Struct");
+    outputNameAccessor("Meta_StructMember");
+    outputNameAccessor("Meta_Enum");
+    outputNameAccessor("Meta_EnumMember");
+
+    // Compile time descriptors, see outputStructFields
+    outputf("template <typename S, typename T>\n"
+            "struct Meta_Field {\n"
+            "    const char *name;\n"
+            "    T S::*pointer;\n"
+            "    Meta_Type type;\n"
+            "    int flags;\n"
+            "    int arraySize;\n"
+            "    int index;\n"
+            "};\n\n"
+            "template <typename S, typename Visitor>\n"
+            "struct Meta_MemberVisitor {\n"
+            "    S &s;\n"
+            "    Visitor &visitor;\n\n"
+            "    template <typename Owner, typename T>\n"
+            "    void operator()(const Meta_Field<Owner, T> &field) const {\n"
+            "        visitor(field, s.*field.pointer);\n"
+            "    }\n"
+            "};\n\n"
+            "template <typename S, typename Visitor>\n"
+            "inline void meta_forEachMember(S &s, Visitor &&visitor) {\n"
+            "    Meta_MemberVisitor<S, Visitor> memberVisitor = { s, visitor };\n"
+            "    meta_forEachField(&s, memberVisitor);\n"
+            "}\n\n");
+
+    // Deltas are written with the serializer's writer and reader
+    if (generateSerializers || generateDelta) {
+        outputSerializerDefinitions();
+    }
+
+    if (generateHash || generateDelta) {
+        outputf("inline bool meta_stringEquals(const char *a, const char *b) {\n"
+                "    return a == b || (a && b && strcmp(a, b) == 0);\n"
+                "}\n\n");
+    }
+
+    if (generateJson) {
+        outputJsonDefinitions();
+    }
+
+    if (generateHash) {
+        outputHashDefinitions();
+    }
+
+    if (generateDelta) {
+        outputDeltaDefinitions();
+    }
+
+    if (usedIntrospectOptions & IntrospectOption_Soa) {
+        outputSoaDefinitions();
+    }
+
+    if (usedIntrospectOptions & IntrospectOption_Flags) {
+        outputFlagsDefinitions();
+    }
+
+    if (generateRegistry) {
+        outputRegistryDefinitions();
+    }
+}
+
+static void
+outputTypesEnum() {
+    outputf("enum Meta_Type {\n");
+
+    for (int i = 0; i < stringHash.count; i++) {
+        StringHashEntry *entry = stringHash.entries + i;
+        outputf("    Meta_Type_%.*s,\n", entry->value.length, entry->value.data);
+    }
+
+    outputf("};\n\n");
+}
+
+/*
+ * A name in a table, either as a literal or as its offset in meta_strings.
+ */
+static void
+outputName(String *name) {
+    if (constTables) {
+        outputf("%lld", (long long)stringPoolOffset(name));
+    } else {
+        outputf("\"%.*s\"", name->length, name->data);
+    }
+}
+
+static void 
+outputStructTables(Struct *s, TableLinkage linkage) {
+    String *name = &s->name.text;
+
+    outputf("%sMeta_Struct meta_%.*s = { ", tablePrefix(linkage), name->length, name->data);
+    outputName(name);
+    outputf(", %d, sizeof(%.*s), alignof(%.*s) };\n\n", s->memberCount, 
+            name->length, name->data, name->length, name->data);
+
+    outputf("%sMeta_StructMember meta_%.*s_members[] = {\n", tablePrefix(linkage), s->name.text.length, s->name.text.data);
+
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        char flags[512];
+        formatMemberFlags(member, flags);
+
+        String *memberName = &member->name.text;
+
+        outputf("    { ");
+        outputName(memberName);
+        outputf(", Meta_Type_%.*s, %s, %s%.*s, offsetof(%.*s, %.*s), ", 
+                member->type.text.length, member->type.text.data,
+                flags, !member->isArray ? "0" : "", 
+                member->arraySize.text.length, member->arraySize.text.data,
+                name->length, name->data, memberName->length, memberName->data);
+
+        // Padding runs up to the next member, or the end of the struct for the last one
+        outputf("sizeof(%.*s::%.*s), alignof(decltype(%.*s::%.*s)), ", name->length, name->data, 
+                memberName->length, memberName->data, name->length, name->data, memberName->length, memberName->data);
+        if (member->next) {
+            outputf("offsetof(%.*s, %.*s) - ", name->length, name->data, 
+                    member->next->name.text.length, member->next->name.text.data);
+        } else {
+            outputf("sizeof(%.*s) - ", name->length, name->data);
+        }
+        outputf("offsetof(%.*s, %.*s) - sizeof(%.*s::%.*s) },\n", name->length, name->data, 
+                memberName->length, memberName->data, name->length, name->data, memberName->length, memberName->data);
+    }
+
+    outputf("};\n\n");
+}
+
+/*
+ * meta_forEachField calls the visitor once per member with a Meta_Field built from constants, so once it's inlined
+ * the compiler sees each member's type, name and member pointer directly and meta_forEachMember turns into plain
+ * field accesses with no dispatch on the member type. The pointer argument only selects the overload.
+ */
+static void
+outputStructFields(Struct *s) {
+    outputf("template <typename Visitor>\n"
+            "inline void meta_forEachField(const %.*s *, Visitor &&visitor) {\n", s->name.text.length, s->name.text.data);
+
+    int index = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next, index++) {
+        char flags[512];
+        formatMemberFlags(member, flags);
+
+        outputf("    visitor(Meta_Field<%.*s, decltype(%.*s::%.*s)>{ \"%.*s\", &%.*s::%.*s, Meta_Type_%.*s, %s, %s%.*s, %d });\n",
+                s->name.text.length, s->name.text.data, 
+                s->name.text.length, s->name.text.data, member->name.text.length, member->name.text.data,
+                member->name.text.length, member->name.text.data,
+                s->name.text.length, s->name.text.data, member->name.text.length, member->name.text.data,
+                member->type.text.length, member->type.text.data,
+                flags, !member->isArray ? "0" : "", 
+                member->arraySize.text.length, member->arraySize.text.data, index);
+    }
+
+    outputf("}\n\n");
+}
+
+enum SerializeDirection {
+    SerializeDirection_Write,
+    SerializeDirection_Read
+};
+
+static void
+outputSerializeRun(MemberRunGenerator *generator, const char *indent) {
+    if (*(SerializeDirection *)generator->data == SerializeDirection_Write) {
+        outputf("%smeta_writeBytes(writer, (const char *)&s + start, end - start);\n", indent);
+    } else {
+        outputf("%smeta_readBytes(reader, (char *)s + start, end - start);\n", indent);
+    }
+}
+
+static void
+outputSerializeMember(MemberRunGenerator *generator, StructMember *member, const char *index, const char *indent) {
+    bool isStruct = isIntrospectedStruct(member);
+
+    if (*(SerializeDirection *)generator->data == SerializeDirection_Write) {
+        outputf("%s%s(writer, s.%.*s%s);\n", indent, isStruct ? "meta_serialize" : "meta_serializePointer", 
+                member->name.text.length, member->name.text.data, index);
+    } else {
+        outputf("%s%s(reader, &s->%.*s%s);\n", indent, isStruct ? "meta_deserialize" : "meta_deserializePointer", 
+                member->name.text.length, member->name.text.data, index);
+    }
+}
+
+static void
+outputSerializeFunction(Struct *s, SerializeDirection direction) {
+    String *name = &s->name.text;
+
+    if (direction == SerializeDirection_Write) {
+        outputf("template <typename Writer>\n"
+                "inline void meta_serialize(Writer *writer, const %.*s &s) {\n", name->length, name->data);
+    } else {
+        outputf("template <typename Reader>\n"
+                "inline bool meta_deserialize(Reader *reader, %.*s *s) {\n", name->length, name->data);
+    }
+
+    MemberRunGenerator generator = {};
+    generator.s = s;
+    generator.plainRequirement = "serialized";
+    generator.isPlain = isSerializePlain;
+    generator.outputRun = outputSerializeRun;
+    generator.outputMember = outputSerializeMember;
+    generator.data = &direction;
+    outputMemberRuns(&generator);
+
+    if (direction == SerializeDirection_Read) {
+        outputf("    return !reader->failed;\n");
+    }
+
+    outputf("}\n\n");
+}
+
+static bool
+isJsonMember(StructMember *member) {
+    return !member->isPointer || tokenMatchesString(&member->type, "char");
+}
+
+static bool
+isJsonString(StructMember *member) {
+    return member->isArray && !member->isPointer && tokenMatchesString(&member->type, "char");
+}
+
+static void
+outputJsonWriter(Struct *s) {
+    String *name = &s->name.text;
+
+    outputf("template <typename Writer>\n"
+            "inline void meta_writeJson(Writer *writer, const %.*s &s) {\n", name->length, name->data);
+
+    bool first = true;
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        if (!isJsonMember(member)) continue;
+
+        String *memberName = &member->name.text;
+        outputf("    meta_jsonWriteRaw(writer, \"%s\\\"%.*s\\\":\", %d);\n", first ? "{" : ",",
+                memberName->length, memberName->data, memberName->length + 4);
+        first = false;
+
+        if (isJsonString(member)) {
+            outputf("    meta_jsonWriteString(writer, s.%.*s, strnlen(s.%.*s, sizeof(s.%.*s)));\n",
+                    memberName->length, memberName->data, memberName->length, memberName->data, 
+                    memberName->length, memberName->data);
+        } else if (member->isArray) {
+            outputf("    meta_jsonWriteRaw(writer, \"[\", 1);\n"
+                    "    for (size_t i = 0; i < sizeof(s.%.*s) / sizeof(s.%.*s[0]); i++) {\n"
+                    "        if (i) meta_jsonWriteRaw(writer, \",\", 1);\n"
+                    "        meta_writeJson(writer, s.%.*s[i]);\n"
+                    "    }\n"
+                    "    meta_jsonWriteRaw(writer, \"]\", 1);\n",
+                    memberName->length, memberName->data, memberName->length, memberName->data, 
+                    memberName->length, memberName->data);
+        } else {
+            outputf("    meta_writeJson(writer, s.%.*s);\n", memberName->length, memberName->data);
+        }
+    }
+
+    if (first) {
+        outputf("    meta_jsonWriteRaw(writer, \"{}\", 2);\n");
+    } else {
+        outputf("    meta_jsonWriteRaw(writer, \"}\", 1);\n");
+    }
+
+    outputf("}\n\n");
+}
+
+static void
+outputJsonMemberRead(StructMember *member) {
+    String *memberName = &member->name.text;
+
+    if (isJsonString(member)) {
+        outputf("            meta_jsonReadString(reader, s->%.*s, sizeof(s->%.*s));\n",
+                memberName->length, memberName->data, memberName->length, memberName->data);
+    } else if (member->isArray) {
+        outputf("            if (!meta_jsonExpect(reader, '[')) return false;\n"
+                "            if (!meta_jsonConsume(reader, ']')) {\n"
+                "                size_t i = 0;\n"
+                "                do {\n"
+                "                    if (i < sizeof(s->%.*s) / sizeof(s->%.*s[0])) meta_readJson(reader, &s->%.*s[i++]);\n"
+                "                    else meta_jsonSkipValue(reader);\n"
+                "                } while (meta_jsonConsume(reader, ','));\n"
+                "                meta_jsonExpect(reader, ']');\n"
+                "            }\n",
+                memberName->length, memberName->data, memberName->length, memberName->data, 
+                memberName->length, memberName->data);
+    } else {
+        outputf("            meta_readJson(reader, &s->%.*s);\n", memberName->length, memberName->data);
+    }
+}
+
+static void
+outputJsonReader(Struct *s) {
+    String *name = &s->name.text;
+
+    outputf("template <typename Reader>\n"
+            "inline bool meta_readJson(Reader *reader, %.*s *s) {\n", name->length, name->data);
+
+    StructMember **members = (StructMember **)malloc((s->memberCount ? s->memberCount : 1) * sizeof(StructMember *));
+    String *keys = (String *)malloc((s->memberCount ? s->memberCount : 1) * sizeof(String));
+    int count = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        if (!isJsonMember(member)) continue;
+        members[count] = member;
+        keys[count++] = member->name.text;
+    }
+
+    PerfectHash hash = {};
+    if (count) {
+        buildPerfectHash(&hash, keys, count);
+        outputIntArray("unsigned int", "displacements", (int *)hash.displacements, hash.bucketCount);
+        outputIntArray("int", "slots", hash.slots, hash.slotCount);
+    }
+
+    outputf("    if (!meta_jsonExpect(reader, '{')) return false;\n"
+            "    if (meta_jsonConsume(reader, '}')) return true;\n"
+            "    do {\n"
+            "        const char *key;\n"
+            "        size_t length;\n"
+            "        if (!meta_jsonReadKey(reader, &key, &length)) return false;\n");
+
+    if (count) {
+        outputf("        uint64_t hash = meta_hashName(key, (int)length);\n"
+                "        switch (slots[meta_hashSlot(hash, displacements[hash & %d], %d)]) {\n", 
+                hash.bucketCount - 1, hash.slotCount - 1);
+
+        for (int i = 0; i < count; i++) {
+            String *memberName = &members[i]->name.text;
+            outputf("        case %d:\n"
+                    "            if (length != %d || memcmp(key, \"%.*s\", %d) != 0) break;\n",
+                    i, memberName->length, memberName->length, memberName->data, memberName->length);
+            outputJsonMemberRead(members[i]);
+            outputf("            continue;\n");
+        }
+
+        outputf("        }\n");
+    }
+
+    outputf("        meta_jsonSkipValue(reader);\n"
+            "    } while (meta_jsonConsume(reader, ','));\n"
+            "    return meta_jsonExpect(reader, '}');\n"
+            "}\n\n");
+
+    freePerfectHash(&hash);
+    free(members);
+    free(keys);
+}
+
+static void
+outputEnumJson(Enum *e) {
+    String *name = &e->name.text;
+
+    outputf("template <typename Writer>\n"
+            "inline void meta_writeJson(Writer *writer, %.*s value) {\n"
+            "    const char *name = meta_getName(value);\n"
+            "    if (name) meta_jsonWriteString(writer, name, strlen(name));\n"
+            "    else meta_writeJson(writer, (long long)value);\n"
+            "}\n\n", name->length, name->data);
+
+    outputf("template <typename Reader>\n"
+            "inline bool meta_readJson(Reader *reader, %.*s *value) {\n"
+            "    meta_jsonSkipWhitespace(reader);\n"
+            "    if (reader->at < reader->end && *reader->at != '\"') {\n"
+            "        // Read as the underlying type, so numbers it can't hold fail\n"
+            "        typename std::underlying_type<%.*s>::type number;\n"
+            "        if (!meta_readJson(reader, &number)) return false;\n"
+            "        *value = (%.*s)number;\n"
+            "        return true;\n"
+            "    }\n"
+            "    const char *name;\n"
+            "    size_t length;\n"
+            "    if (!meta_jsonReadRawString(reader, &name, &length)) return false;\n"
+            "    return meta_fromName(name, (int)length, value) || meta_jsonFail(reader);\n"
+            "}\n\n", name->length, name->data, name->length, name->data, name->length, name->data);
+}
+
+/*
+ * Outputs format once per member of s. Every %.*s in format is the member name, at most four of them.
+ */
+static void
+outputForEachMember(Struct *s, const char *format) {
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        String *memberName = &member->name.text;
+        outputf(format, memberName->length, memberName->data, memberName->length, memberName->data,
+                memberName->length, memberName->data, memberName->length, memberName->data);
+    }
+}
+
+static void
+outputSoa(Struct *s) {
+    String *name = &s->name.text;
+
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        outputf("static_assert(std::is_trivially_copyable<decltype(%.*s::%.*s)>::value, "
+                "\"%.*s::%.*s must be trivially copyable to be stored in %.*s_SoA\");\n",
+                name->length, name->data, member->name.text.length, member->name.text.data,
+                name->length, name->data, member->name.text.length, member->name.text.data,
+                name->length, name->data);
+    }
+
+    outputf("\nstruct %.*s_SoA {\n"
+            "    int count;\n"
+            "    int capacity;\n"
+            "    void *block;\n", name->length, name->data);
+    for (StructMember *member = s->firstMember; member; member = member->next) {
+        outputf("    decltype(%.*s::%.*s) *%.*s;\n", name->length, name->data, 
+                member->name.text.length, member->name.text.data, member->name.text.length, member->name.text.data);
+    }
+    outputf("};\n\n");
+
+    outputf("inline void meta_free(%.*s_SoA *soa) {\n"
+            "    free(soa->block);\n"
+            "    *soa = {};\n"
+            "}\n\n", name->length, name->data);
+
+    outputf("inline void meta_reserve(%.*s_SoA *soa, int capacity) {\n"
+            "    if (capacity <= soa->capacity) return;\n"
+            "    int newCapacity = soa->capacity ? soa->capacity : 16;\n"
+            "    while (newCapacity < capacity) newCapacity *= 2;\n"
+            "    size_t size = 63;\n", name->length, name->data);
+    outputForEachMember(s, "    size += meta_soaArraySize(sizeof(*soa->%.*s), newCapacity);\n");
+    outputf("    void *block = malloc(size);\n"
+            "    char *at = (char *)(((uintptr_t)block + 63) & ~(uintptr_t)63);\n");
+    outputForEachMember(s, "    soa->%.*s = (decltype(soa->%.*s))meta_soaMove(&at, soa->%.*s, sizeof(*soa->%.*s), soa->count, newCapacity);\n");
+    outputf("    free(soa->block);\n"
+            "    soa->block = block;\n"
+            "    soa->capacity = newCapacity;\n"
+            "}\n\n");
+
+    outputf("inline void meta_resize(%.*s_SoA *soa, int count) {\n"
+            "    meta_reserve(soa, count);\n"
+            "    if (count > soa->count) {\n"
+            "        int added = count - soa->count;\n", name->length, name->data);
+    outputForEachMember(s, "        memset(soa->%.*s + soa->count, 0, added * sizeof(*soa->%.*s));\n");
+    outputf("    }\n"
+            "    soa->count = count;\n"
+            "}\n\n");
+
+    outputf("inline %.*s meta_getElement(const %.*s_SoA *soa, int index) {\n"
+            "    %.*s value;\n", name->length, name->data, name->length, name->data, name->length, name->data);
+    outputForEachMember(s, "    memcpy(&value.%.*s, &soa->%.*s[index], sizeof(value.%.*s));\n");
+    outputf("    return value;\n"
+            "}\n\n");
+
+    outputf("inline void meta_setElement(%.*s_SoA *soa, int index, const %.*s &value) {\n", 
+            name->length, name->data, name->length, name->data);
+    outputForEachMember(s, "    memcpy(&soa->%.*s[index], &value.%.*s, sizeof(value.%.*s));\n");
+    outputf("}\n\n");
+
+    outputf("inline int meta_push(%.*s_SoA *soa, const %.*s &value) {\n"
+            "    if (soa->count == soa->capacity) meta_reserve(soa, soa->count + 1);\n"
+            "    int index = soa->count++;\n"
+            "    meta_setElement(soa, index, value);\n"
+            "    return index;\n"
+            "}\n\n", name->length, name->data, name->length, name->data);
+
+    outputf("// Keeps the order of the remaining elements\n"
+            "inline void meta_remove(%.*s_SoA *soa, int index) {\n"
+            "    int moved = soa->count - index - 1;\n", name->length, name->data);
+    outputForEachMember(s, "    memmove(soa->%.*s + index, soa->%.*s + index + 1, moved * sizeof(*soa->%.*s));\n");
+    outputf("    soa->count--;\n"
+            "}\n\n");
+
+    outputf("// Moves the last element into the gap\n"
+            "inline void meta_removeSwap(%.*s_SoA *soa, int index) {\n"
+            "    int last = --soa->count;\n"
+            "    if (index == last) return;\n", name->length, name->data);
+    outputForEachMember(s, "    memcpy(soa->%.*s + index, soa->%.*s + last, sizeof(*soa->%.*s));\n");
+    outputf("}\n\n");
+
+    outputf("inline void meta_appendAoS(%.*s_SoA *soa, const %.*s *items, int count) {\n"
+            "    meta_reserve(soa, soa->count + count);\n"
+            "    for (int i = 0; i < count; i++) meta_setElement(soa, soa->count + i, items[i]);\n"
+            "    soa->count += count;\n"
+            "}\n\n", name->length, name->data, name->length, name->data);
+
+    outputf("inline void meta_copyToAoS(const %.*s_SoA *soa, %.*s *items) {\n"
+            "    for (int i = 0; i < soa->count; i++) items[i] = meta_getElement(soa, i);\n"
+            "}\n\n", name->length, name->data, name->length, name->data);
+}
+
+static void 
+outputStruct(Struct *s, TableLinkage linkage = TableLinkage_Global) {
+    if (linkage == TableLinkage_Extern) {
+        outputf("extern %sMeta_Struct meta_%.*s;\n"
+                "extern %sMeta_StructMember meta_%.*s_members[];\n\n",
+                constPrefix(), s->name.text.length, s->name.text.data, 
+                constPrefix(), s->name.text.length, s->name.text.data);
+    } else {
+        outputStructTables(s, linkage);
+    }
+
+    outputf("inline %sMeta_Struct *meta_get(%.*s *) {\n"
+           "    return &meta_%.*s;\n"
+           "}\n\n", 
+           constPrefix(), s->name.text.length, s->name.text.data, s->name.text.length, s->name.text.data);
+
+    outputf("inline %sMeta_StructMember *meta_getMembers(%.*s *) {\n"
+           "    return meta_%.*s_members;\n"
+           "}\n\n", 
+           constPrefix(), s->name.text.length, s->name.text.data, s->name.text.length, s->name.text.data);
+
+    outputStructFields(s);
+
+    if (generateSerializers) {
+        outputSerializeFunction(s, SerializeDirection_Write);
+        outputSerializeFunction(s, SerializeDirection_Read);
+    }
+
+    if (generateJson) {
+        outputJsonWriter(s);
+        outputJsonReader(s);
+    }
+
+    if (generateHash) {
+        outputHashFunctions(s);
+    }
+
+    if (generateDelta) {
+        outputDeltaFunctions(s);
+    }
+
+    if (s->options & IntrospectOption_Soa) {
+        outputSoa(s);
+    }
+}
+
+/*
+ * How value to name lookups are generated for an enum. Dense enums get a flat name table indexed by value, sparse ones
+ * a switch, which the compiler turns into a jump table or binary search. If we couldn't work out every value we don't
+ * know which of those fits, so the lookup scans the member table instead.
+ */
+enum EnumLookup {
+    EnumLookup_Table,
+    EnumLookup_Switch,
+    EnumLookup_Scan
+};
+
+struct EnumLayout {
+    EnumLookup lookup;
+    int64_t minValue;
+    int64_t range;
+};
+
+struct EnumValueEntry {
+    int64_t value;
+    int index;
+};
+
+static int
+compareEnumValueEntries(const void *a, const void *b) {
+    const EnumValueEntry *left = (const EnumValueEntry *)a;
+    const EnumValueEntry *right = (const EnumValueEntry *)b;
+    if (left->value != right->value) return left->value < right->value ? -1 : 1;
+    return left->index - right->index;
+}
+
+/*
+ * Flags, in member order, which members are the first with their value, so aliases like Foo_Count = Foo_Last don't
+ * hide the real name. Only meaningful when every value is known. Returns the number of distinct values.
+ */
+static int
+findFirstWithValue(Enum *e, bool *isFirst) {
+    EnumValueEntry *entries = (EnumValueEntry *)malloc((e->memberCount ? e->memberCount : 1) * sizeof(EnumValueEntry));
+
+    int count = 0;
+    for (EnumMember *member = e->firstMember; member; member = member->next) {
+        entries[count].value = member->value;
+        entries[count].index = count;
+        count++;
+    }
+
+    qsort(entries, count, sizeof(EnumValueEntry), compareEnumValueEntries);
+
+    int uniqueCount = 0;
+    for (int i = 0; i < count; i++) {
+        bool first = i == 0 || entries[i].value != entries[i - 1].value;
+        if (isFirst) isFirst[entries[i].index] = first;
+        if (first) uniqueCount++;
+    }
+
+    free(entries);
+    return uniqueCount;
+}
+
+static EnumLayout
+getEnumLayout(Enum *e) {
+    EnumLayout layout = {};
+    layout.lookup = EnumLookup_Scan;
+
+    int64_t minValue = INT64_MAX;
+    int64_t maxValue = INT64_MIN;
+
+    for (EnumMember *member = e->firstMember; member; member = member->next) {
+        if (!member->isValueKnown) return layout;
+
+        if (member->value < minValue) minValue = member->value;
+        if (member->value > maxValue) maxValue = member->value;
+    }
+
+    if (!e->firstMember) return layout;
+
+    int uniqueCount = findFirstWithValue(e, nullptr);
+
+    if (minValue < INT32_MIN || maxValue > INT32_MAX) {
+        layout.lookup = EnumLookup_Switch;
+        return layout;
+    }
+
+    layout.minValue = minValue;
+    layout.range = maxValue - minValue + 1;
+
+    // A table is worth a few holes
+    int64_t tableLimit = uniqueCount * 2 > 16 ? uniqueCount * 2 : 16;
+    layout.lookup = layout.range <= tableLimit ? EnumLookup_Table : EnumLookup_Switch;
+
+    return layout;
+}
+
+static void
+outputEnumTables(Enum *e, TableLinkage linkage) {
+    outputf("%sMeta_Enum meta_%.*s = { ", tablePrefix(linkage), e->name.text.length, e->name.text.data);
+    outputName(&e->name.text);
+    outputf(", %d };\n\n", e->memberCount);
+
+    outputf("%sMeta_EnumMember meta_%.*s_members[] = {\n", tablePrefix(linkage), e->name.text.length, e->name.text.data);
+    for (EnumMember *member = e->firstMember; member; member = member->next) {
+        outputf("    { ");
+        outputName(&member->name.text);
+        outputf(", %.*s },\n", member->name.text.length, member->name.text.data);
+    }
+    outputf("};\n\n");
+
+    EnumLayout layout = getEnumLayout(e);
+    if (layout.lookup == EnumLookup_Table) {
+        // Indexed by value - minValue, holes are null
+        EnumMember **byValue = (EnumMember **)calloc(layout.range, sizeof(EnumMember *));
+        for (EnumMember *member = e->firstMember; member; member = member->next) {
+            EnumMember **slot = byValue + (member->value - layout.minValue);
+            if (!*slot) *slot = member;
+        }
+
+        // With --const-tables holes are offset 0, the empty string
+        outputf("%s%s meta_%.*s_names[%lld] = {\n", tablePrefix(linkage), constTables ? "uint32_t" : "const char *",
+                e->name.text.length, e->name.text.data, (long long)layout.range);
+        for (int64_t i = 0; i < layout.range; i++) {
+            if (byValue[i]) {
+                outputf("    ");
+                outputName(&byValue[i]->name.text);
+                outputf(",\n");
+            } else {
+                outputf(constTables ? "    0,\n" : "    nullptr,\n");
+            }
+        }
+        outputf("};\n\n");
+
+        free(byValue);
+    }
+}
+
+static void
+outputEnumGetName(Enum *e) {
+    EnumLayout layout = getEnumLayout(e);
+    String *name = &e->name.text;
+
+    outputf("inline const char *meta_getName(%.*s value) {\n", name->length, name->data);
+
+    switch (layout.lookup) {
+    case EnumLookup_Table:
+        outputf("    uint64_t index = (uint64_t)((int64_t)value - (%lld));\n", (long long)layout.minValue);
+        if (constTables) {
+            outputf("    if (index >= %lld || !meta_%.*s_names[index]) return nullptr;\n"
+                    "    return meta_strings + meta_%.*s_names[index];\n", 
+                    (long long)layout.range, name->length, name->data, name->length, name->data);
+        } else {
+            outputf("    return index < %lld ? meta_%.*s_names[index] : nullptr;\n", 
+                    (long long)layout.range, name->length, name->data);
+        }
+        break;
+
+    case EnumLookup_Switch: {
+        bool *isFirst = (bool *)malloc(e->memberCount);
+        findFirstWithValue(e, isFirst);
+
+        outputf("    switch (value) {\n");
+        int index = 0;
+        for (EnumMember *member = e->firstMember; member; member = member->next, index++) {
+            if (!isFirst[index]) continue;
+            outputf("    case %.*s: return \"%.*s\";\n", member->name.text.length, member->name.text.data, 
+                    member->name.text.length, member->name.text.data);
+        }
+        outputf("    default: return nullptr;\n"
+                "    }\n");
+
+        free(isFirst);
+        break;
+    }
+
+    case EnumLookup_Scan:
+        outputf("    for (int i = 0; i < %d; i++) {\n"
+                "        if (meta_%.*s_members[i].value == (int)value) return meta_getName(meta_%.*s_members + i);\n"
+                "    }\n"
+                "    return nullptr;\n", 
+                e->memberCount, name->length, name->data, name->length, name->data);
+        break;
+    }
+
+    outputf("}\n\n");
+}
+
+/*
+ * meta_fromName finds a member by name through a perfect hash built here, so a lookup is one hash, two table reads
+ * and one string compare whether or not the name exists.
+ */
+static void
+outputEnumFromName(Enum *e) {
+    String *name = &e->name.text;
+
+    if (e->memberCount == 0) {
+        // Nothing to look up, and named parameters would be unused
+        outputf("inline bool meta_fromName(const char *, int, %.*s *) {\n"
+                "    return false;\n"
+                "}\n\n", name->length, name->data);
+    } else {
+        outputf("inline bool meta_fromName(const char *name, int length, %.*s *value) {\n", name->length, name->data);
+
+        String *keys = (String *)malloc(e->memberCount * sizeof(String));
+        int *lengths = (int *)malloc(e->memberCount * sizeof(int));
+        int count = 0;
+        for (EnumMember *member = e->firstMember; member; member = member->next) {
+            lengths[count] = member->name.text.length;
+            keys[count++] = member->name.text;
+        }
+
+        PerfectHash hash;
+        buildPerfectHash(&hash, keys, count);
+
+        outputIntArray("unsigned int", "displacements", (int *)hash.displacements, hash.bucketCount);
+        outputIntArray("int", "slots", hash.slots, hash.slotCount);
+        outputIntArray("int", "lengths", lengths, count);
+
+        outputf("    uint64_t hash = meta_hashName(name, length);\n"
+                "    int index = slots[meta_hashSlot(hash, displacements[hash & %d], %d)];\n"
+                "    if (index < 0 || lengths[index] != length || memcmp(meta_getName(meta_%.*s_members + index), name, length) != 0) return false;\n"
+                "    *value = (%.*s)meta_%.*s_members[index].value;\n"
+                "    return true;\n"
+                "}\n\n",
+                hash.bucketCount - 1, hash.slotCount - 1, name->length, name->data, 
+                name->length, name->data, name->length, name->data);
+
+        freePerfectHash(&hash);
+        free(keys);
+        free(lengths);
+    }
+
+    outputf("inline bool meta_fromName(const char *name, %.*s *value) {\n"
+            "    return meta_fromName(name, (int)strlen(name), value);\n"
+            "}\n\n", 
+            name->length, name->data);
+}
+
+/*
+ * Flag enums are valid when they have no bits outside of their flags. Other enums are valid when they're a member,
+ * which dense enums check against a bitset of the values and the rest by looking up the name.
+ */
+static void
+outputEnumIsValid(Enum *e) {
+    String *name = &e->name.text;
+
+    outputf("inline bool meta_isValid(%.*s value) {\n", name->length, name->data);
+
+    if (e->options & IntrospectOption_Flags) {
+        // The compiler folds this into a single constant, whether or not we know the values
+        outputf("    const uint64_t mask = 0");
+        for (EnumMember *member = e->firstMember; member; member = member->next) {
+            outputf("\n        | (uint64_t)%.*s", member->name.text.length, member->name.text.data);
+        }
+        outputf(";\n"
+                "    return ((uint64_t)value & ~mask) == 0;\n"
+                "}\n\n");
+        return;
+    }
+
+    EnumLayout layout = getEnumLayout(e);
+    if (layout.lookup == EnumLookup_Table) {
+        int wordCount = (int)((layout.range + 63) / 64);
+        uint64_t *bits = (uint64_t *)calloc(wordCount, sizeof(uint64_t));
+        for (EnumMember *member = e->firstMember; member; member = member->next) {
+            int64_t index = member->value - layout.minValue;
+            bits[index >> 6] |= 1ull << (index & 63);
+        }
+
+        outputf("    uint64_t index = (uint64_t)((int64_t)value - (%lld));\n", (long long)layout.minValue);
+        if (wordCount == 1) {
+            outputf("    return index < %lld && ((0x%llxull >> index) & 1);\n", 
+                    (long long)layout.range, (unsigned long long)bits[0]);
+        } else {
+            outputf("    static const uint64_t bits[%d] = {", wordCount);
+            for (int i = 0; i < wordCount; i++) {
+                outputf(i % 4 == 0 ? "\n        0x%llxull," : " 0x%llxull,", (unsigned long long)bits[i]);
+            }
+            outputf("\n    };\n"
+                    "    return index < %lld && ((bits[index >> 6] >> (index & 63)) & 1);\n", (long long)layout.range);
+        }
+
+        free(bits);
+    } else {
+        outputf("    return meta_getName(value) != nullptr;\n");
+    }
+
+    outputf("}\n\n");
+}
+
+static int
+flagBitCount(EnumMember *member) {
+    return __builtin_popcountll((uint64_t)member->value);
+}
+
+/*
+ * The formatter tries an exact match first, so zero and combined flags get their own name, then takes flags in table
+ * order wherever all of their bits are still set. Combined flags go first so they're used in place of their parts.
+ */
+static void
+outputEnumFlags(Enum *e) {
+    String *name = &e->name.text;
+
+    EnumMember **members = (EnumMember **)malloc((e->memberCount ? e->memberCount : 1) * sizeof(EnumMember *));
+    bool *isFirst = (bool *)malloc(e->memberCount ? e->memberCount : 1);
+    bool isKnown = true;
+    int count = 0;
+    for (EnumMember *member = e->firstMember; member; member = member->next) {
+        isKnown &= member->isValueKnown;
+    }
+
+    // Without the values we can't order them or drop aliases, so the table is in declaration order
+    if (isKnown) findFirstWithValue(e, isFirst);
+    int index = 0;
+    for (EnumMember *member = e->firstMember; member; member = member->next, index++) {
+        if (!isKnown || isFirst[index]) members[count++] = member;
+    }
+
+    if (isKnown) {
+        // Enums are small and this keeps the declaration order otherwise
+        for (int i = 1; i < count; i++) {
+            EnumMember *member = members[i];
+            int bitCount = flagBitCount(member);
+            int j = i;
+            while (j > 0 && bitCount > 1 && flagBitCount(members[j - 1]) < bitCount) {
+                members[j] = members[j - 1];
+                j--;
+            }
+            members[j] = member;
+        }
+    }
+
+    outputf("inline int meta_formatFlags(%.*s value, char *buffer, int capacity) {\n", name->length, name->data);
+    if (count && constTables) {
+        outputf("    static constexpr char names[] =");
+        for (int i = 0; i < count; i++) {
+            outputf("\n        \"%.*s\\0\"", members[i]->name.text.length, members[i]->name.text.data);
+        }
+        outputf(";\n"
+                "    static constexpr Meta_Flag flags[%d] = {\n", count);
+        int offset = 0;
+        for (int i = 0; i < count; i++) {
+            String *memberName = &members[i]->name.text;
+            outputf("        { (uint64_t)%.*s, %d, %d },\n", memberName->length, memberName->data,
+                    offset, memberName->length);
+            offset += memberName->length + 1;
+        }
+        outputf("    };\n"
+                "    return meta_formatFlagValue((uint64_t)value, flags, %d, names, buffer, capacity);\n", count);
+    } else if (count) {
+        outputf("    static const Meta_Flag flags[%d] = {\n", count);
+        for (int i = 0; i < count; i++) {
+            String *memberName = &members[i]->name.text;
+            outputf("        { (uint64_t)%.*s, \"%.*s\", %d },\n", memberName->length, memberName->data,
+                    memberName->length, memberName->data, memberName->length);
+        }
+        outputf("    };\n"
+                "    return meta_formatFlagValue((uint64_t)value, flags, %d, buffer, capacity);\n", count);
+    } else {
+        outputf("    return meta_formatFlagValue((uint64_t)value, nullptr, 0, %sbuffer, capacity);\n",
+                constTables ? "nullptr, " : "");
+    }
+    outputf("}\n\n");
+
+    free(members);
+    free(isFirst);
+}
+
+static void
+outputEnum(Enum *e, TableLinkage linkage = TableLinkage_Global) {
+    if (linkage == TableLinkage_Extern) {
+        outputf("extern %sMeta_Enum meta_%.*s;\n"
+                "extern %sMeta_EnumMember meta_%.*s_members[];\n",
+                constPrefix(), e->name.text.length, e->name.text.data, 
+                constPrefix(), e->name.text.length, e->name.text.data);
+        if (getEnumLayout(e).lookup == EnumLookup_Table) {
+            outputf("extern %s meta_%.*s_names[];\n", constTables ? "const uint32_t" : "const char *", 
+                    e->name.text.length, e->name.text.data);
+        }
+        outputf("\n");
+    } else {
+        outputEnumTables(e, linkage);
+    }
+
+    outputEnumGetName(e);
+    outputEnumFromName(e);
+    outputEnumIsValid(e);
+
+    if (e->options & IntrospectOption_Flags) {
+        outputEnumFlags(e);
+    }
+
+    if (generateJson) {
+        outputEnumJson(e);
+    }
+
+    outputf("inline %sMeta_Enum *meta_get(%.*s) {\n"
+           "    return &meta_%.*s;\n"
+           "}\n\n", 
+           constPrefix(), e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data);
+    
+    outputf("inline %sMeta_EnumMember *meta_getMembers(%.*s) {\n"
+           "    return meta_%.*s_members;\n"
+           "}\n\n", 
+           constPrefix(), e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data);
+}
+
+/*
+ * The introspected struct or enum behind each Meta_Type, and every member of those, as the registry lists them. The
+ * first definition of a name wins, and a struct wins over an enum.
+ */
+
+struct RegistryMember {
+    int owner;
+    int index;
+    // "Owner.member"
+    String key;
+};
+
+struct TypeRegistry {
+    // Indexed by Meta_Type, null where the type isn't an introspected struct or enum
+    Struct **structs;
+    Enum **enums;
+
+    RegistryMember *members;
+    int memberCount;
+    int memberCapacity;
+    // The "Type.member" names the members' keys point into
+    StringHash memberKeys;
+};
+
+static void
+freeTypeRegistry(TypeRegistry *registry) {
+    free(registry->structs);
+    free(registry->enums);
+    free(registry->members);
+    stringHashFree(&registry->memberKeys);
+    *registry = {};
+}
+
+static void
+outputRegistryTables(TypeRegistry *registry, TableLinkage linkage) {
+    if (stringHash.count) {
+        outputf("%sMeta_TypeEntry meta_typeRegistry[%d] = {\n", tablePrefix(linkage), stringHash.count);
+        for (int i = 0; i < stringHash.count; i++) {
+            String *name = &stringHash.entries[i].value;
+            outputf("    { ");
+            outputName(name);
+            outputf(", Meta_Type_%.*s, ", name->length, name->data);
+            if (constTables) {
+                outputf("Meta_TypeKind_%s },\n", registry->structs[i] ? "Struct" : registry->enums[i] ? "Enum" : "Other");
+            } else if (registry->structs[i]) {
+                outputf("Meta_TypeKind_Struct, &meta_%.*s, meta_%.*s_members, nullptr, nullptr },\n",
+                        name->length, name->data, name->length, name->data);
+            } else if (registry->enums[i]) {
+                outputf("Meta_TypeKind_Enum, nullptr, nullptr, &meta_%.*s, meta_%.*s_members },\n",
+                        name->length, name->data, name->length, name->data);
+            } else {
+                outputf("Meta_TypeKind_Other, nullptr, nullptr, nullptr, nullptr },\n");
+            }
+        }
+        outputf("};\n\n");
+    }
+
+    if (registry->memberCount) {
+        outputf("%sMeta_MemberEntry meta_memberRegistry[%d] = {\n", tablePrefix(linkage), registry->memberCount);
+        for (int i = 0; i < registry->memberCount; i++) {
+            RegistryMember *member = registry->members + i;
+            String *owner = &stringHash.entries[member->owner].value;
+            if (constTables) {
+                // The key is "Owner.member"
+                String memberName = {};
+                memberName.length = member->key.length - owner->length - 1;
+                memberName.data = member->key.data + owner->length + 1;
+                outputf("    { Meta_Type_%.*s, %d, %lld },\n", owner->length, owner->data, member->index,
+                        (long long)stringPoolOffset(&memberName));
+            } else if (registry->structs[member->owner]) {
+                outputf("    { Meta_Type_%.*s, %d, meta_%.*s_members + %d, nullptr },\n", 
+                        owner->length, owner->data, member->index, owner->length, owner->data, member->index);
+            } else {
+                outputf("    { Meta_Type_%.*s, %d, nullptr, meta_%.*s_members + %d },\n", 
+                        owner->length, owner->data, member->index, owner->length, owner->data, member->index);
+            }
+        }
+        outputf("};\n\n");
+    }
+}
+
+/*
+ * With --const-tables the registry can't point at the metadata, so these switches stand in for the pointers in
+ * Meta_TypeEntry. Code can refer to the tables without any relocations, and the switches become jump tables.
+ */
+static void
+outputRegistryMetaLookups(TypeRegistry *registry, TableLinkage linkage) {
+    struct MetaLookup {
+        const char *function;
+        const char *type;
+        const char *format;
+        bool isEnum;
+    };
+    MetaLookup lookups[] = {
+        { "meta_getStructMeta", "Meta_Struct", "&meta_%.*s", false },
+        { "meta_getStructMembers", "Meta_StructMember", "meta_%.*s_members", false },
+        { "meta_getEnumMeta", "Meta_Enum", "&meta_%.*s", true },
+        { "meta_getEnumMembers", "Meta_EnumMember", "meta_%.*s_members", true }
+    };
+
+    // The per input headers aren't included with a source file, so declare what the switches refer to
+    if (linkage == TableLinkage_Extern) {
+        for (int i = 0; i < stringHash.count; i++) {
+            String *name = &stringHash.entries[i].value;
+            if (registry->structs[i]) {
+                outputf("extern const Meta_Struct meta_%.*s;\n"
+                        "extern const Meta_StructMember meta_%.*s_members[];\n",
+                        name->length, name->data, name->length, name->data);
+            } else if (registry->enums[i]) {
+                outputf("extern const Meta_Enum meta_%.*s;\n"
+                        "extern const Meta_EnumMember meta_%.*s_members[];\n",
+                        name->length, name->data, name->length, name->data);
+            }
+        }
+        outputf("\n");
+    }
+
+    for (int lookup = 0; lookup < (int)(sizeof(lookups) / sizeof(lookups[0])); lookup++) {
+        MetaLookup *l = lookups + lookup;
+        outputf("inline const %s *%s(Meta_Type type) {\n"
+                "    switch (type) {\n", l->type, l->function);
+        for (int i = 0; i < stringHash.count; i++) {
+            bool isDefined = l->isEnum ? registry->enums[i] != nullptr : registry->structs[i] != nullptr;
+            if (!isDefined) continue;
+
+            String *name = &stringHash.entries[i].value;
+            outputf("    case Meta_Type_%.*s: return ", name->length, name->data);
+            outputf(l->format, name->length, name->data);
+            outputf(";\n");
+        }
+        outputf("    default: return nullptr;\n"
+                "    }\n"
+                "}\n\n");
+    }
+}
+
+/*
+ * A lookup by Meta_Type is a bounds check and an index. A lookup by name is one hash, two table reads, a length check
+ * and then the compare that confirms the match, the same as meta_fromName.
+ */
+static void
+outputRegistry(TypeRegistry *registry, TableLinkage linkage) {
+    if (linkage == TableLinkage_Extern) {
+        if (stringHash.count) outputf("extern %sMeta_TypeEntry meta_typeRegistry[];\n", constPrefix());
+        if (registry->memberCount) outputf("extern %sMeta_MemberEntry meta_memberRegistry[];\n", constPrefix());
+        outputf("\n");
+    } else {
+        outputRegistryTables(registry, linkage);
+    }
+
+    if (constTables) {
+        outputRegistryMetaLookups(registry, linkage);
+    }
+
+    int typeCount = stringHash.count;
+    const char *prefix = constPrefix();
+
+    outputf("inline %sMeta_TypeEntry *meta_getType(Meta_Type type) {\n", prefix);
+    if (typeCount) {
+        outputf("    return (unsigned int)type < %du ? meta_typeRegistry + type : nullptr;\n", typeCount);
+    } else {
+        outputf("    return nullptr;\n");
+    }
+    outputf("}\n\n");
+
+    outputf("inline %sMeta_TypeEntry *meta_findType(const char *name, int length) {\n", prefix);
+    if (typeCount) {
+        String *keys = (String *)malloc(typeCount * sizeof(String));
+        int *lengths = (int *)malloc(typeCount * sizeof(int));
+        for (int i = 0; i < typeCount; i++) {
+            keys[i] = stringHash.entries[i].value;
+            lengths[i] = keys[i].length;
+        }
+
+        PerfectHash hash;
+        buildPerfectHash(&hash, keys, typeCount);
+
+        outputIntArray("unsigned int", "displacements", (int *)hash.displacements, hash.bucketCount);
+        outputIntArray("int", "slots", hash.slots, hash.slotCount);
+        outputIntArray("int", "lengths", lengths, typeCount);
+
+        outputf("    uint64_t hash = meta_hashName(name, length);\n"
+                "    int index = slots[meta_hashSlot(hash, displacements[hash & %d], %d)];\n"
+                "    if (index < 0 || lengths[index] != length || memcmp(meta_getName(meta_typeRegistry + index), name, length) != 0) return nullptr;\n"
+                "    return meta_typeRegistry + index;\n",
+                hash.bucketCount - 1, hash.slotCount - 1);
+
+        freePerfectHash(&hash);
+        free(keys);
+        free(lengths);
+    } else {
+        outputf("    return nullptr;\n");
+    }
+    outputf("}\n\n"
+            "inline %sMeta_TypeEntry *meta_findType(const char *name) {\n"
+            "    return meta_findType(name, (int)strlen(name));\n"
+            "}\n\n", prefix);
+
+    int memberCount = registry->memberCount;
+
+    outputf("inline %sMeta_MemberEntry *meta_findMember(const char *name, int length) {\n", prefix);
+    if (memberCount) {
+        String *keys = (String *)malloc(memberCount * sizeof(String));
+        int *lengths = (int *)malloc(memberCount * sizeof(int));
+        int *ownerLengths = (int *)malloc(memberCount * sizeof(int));
+        for (int i = 0; i < memberCount; i++) {
+            RegistryMember *member = registry->members + i;
+            keys[i] = member->key;
+            lengths[i] = member->key.length;
+            ownerLengths[i] = stringHash.entries[member->owner].value.length;
+        }
+
+        PerfectHash hash;
+        buildPerfectHash(&hash, keys, memberCount);
+
+        outputIntArray("unsigned int", "displacements", (int *)hash.displacements, hash.bucketCount);
+        outputIntArray("int", "slots", hash.slots, hash.slotCount);
+        outputIntArray("int", "lengths", lengths, memberCount);
+        outputIntArray("int", "ownerLengths", ownerLengths, memberCount);
+
+        // The key isn't stored anywhere, so the owner and member names are compared separately
+        outputf("    uint64_t hash = meta_hashName(name, length);\n"
+                "    int index = slots[meta_hashSlot(hash, displacements[hash & %d], %d)];\n"
+                "    if (index < 0 || lengths[index] != length) return nullptr;\n"
+                "    %sMeta_MemberEntry *entry = meta_memberRegistry + index;\n"
+                "    int ownerLength = ownerLengths[index];\n"
+                "    if (memcmp(meta_getName(meta_typeRegistry + entry->owner), name, ownerLength) != 0 || name[ownerLength] != '.' ||\n"
+                "            memcmp(meta_getName(entry), name + ownerLength + 1, length - ownerLength - 1) != 0) return nullptr;\n"
+                "    return entry;\n",
+                hash.bucketCount - 1, hash.slotCount - 1, prefix);
+
+        freePerfectHash(&hash);
+        free(keys);
+        free(lengths);
+        free(ownerLengths);
+    } else {
+        outputf("    return nullptr;\n");
+    }
+    outputf("}\n\n"
+            "inline %sMeta_MemberEntry *meta_findMember(const char *name) {\n"
+            "    return meta_findMember(name, (int)strlen(name));\n"
+            "}\n\n", prefix);
+}
+
+/*
+ * Input files
+ */
+
+/*
+ * What we know about an input file's contents without parsing it.
+ */
+struct FileStamp {
+    uint64_t size;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint64_t contentHash;
+};
+
+struct InputFile {
+    const char *fileName;
+    FileData file;
+    FileStamp stamp;
+    bool isCacheable;
+    // Whether endOffset is set on the structs and enums, which it isn't for models loaded from the cache
+    bool hasOffsets;
+    // Bytes --watch has parsed again on top of the last full parse, which all stay in the arena
+    size_t reparsedBytes;
+    // Owns everything parsed from this file. Only one worker touches a file, so this is effectively per thread.
+    Arena arena;
+    Struct *firstStruct;
+    Enum *firstEnum;
+};
+
+struct InputList {
+    InputFile *files;
+    int count;
+    int capacity;
+
+    // Every file the output depends on: the inputs plus any response files
+    const char **dependencies;
+    int dependencyCount;
+    int dependencyCapacity;
+};
+
+static void
+addDependency(InputList *inputs, const char *fileName) {
+    if (inputs->dependencyCount == inputs->dependencyCapacity) {
+        inputs->dependencyCapacity = inputs->dependencyCapacity ? inputs->dependencyCapacity * 2 : 16;
+        inputs->dependencies = (const char **)realloc(inputs->dependencies, inputs->dependencyCapacity * sizeof(const char *));
+    }
+    inputs->dependencies[inputs->dependencyCount++] = fileName;
+}
+
+static void
+addInputFile(InputList *inputs, const char *fileName) {
+    addDependency(inputs, fileName);
+
+    if (inputs->count == inputs->capacity) {
+        inputs->capacity = inputs->capacity ? inputs->capacity * 2 : 16;
+        inputs->files = (InputFile *)realloc(inputs->files, inputs->capacity * sizeof(InputFile));
+    }
+
+    InputFile *input = inputs->files + inputs->count++;
+    *input = {};
+    input->fileName = fileName;
+}
+
+/*
+ * A response file lists one input file per line. Blank lines and lines starting with '#' are ignored.
+ */
+static void
+addResponseFile(InputList *inputs, const char *responseFileName) {
+    addDependency(inputs, responseFileName);
+
+    FileData file = openFile(responseFileName);
+
+    const char *at = file.data;
+    const char *end = file.data + file.size;
+
+    while (at < end) {
+        const char *lineEnd = at;
+        while (lineEnd < end && !isNewline(*lineEnd)) lineEnd++;
+
+        const char *first = at;
+        const char *last = lineEnd;
+        while (first < last && isWhitespace(*first)) first++;
+        while (last > first && isWhitespace(last[-1])) last--;
+
+        if (first < last && *first != '#') {
+            int length = last - first;
+            char *fileName = (char *)arenaPush(&globalArena, length + 1, 1);
+            memcpy(fileName, first, length);
+            fileName[length] = '\0';
+            addInputFile(inputs, fileName);
+        }
+
+        at = lineEnd + 1;
+    }
+
+    closeFile(&file);
+}
+
+/*
+ * A stretch of an input parsed in one go. Parsing starts at begin and stops at the first rest point at or past
+ * sync.limit, or the end of the input.
+ */
+struct ParseChunk {
+    InputFile *input;
+    int begin;
+    // Where parsing stopped
+    int end;
+    // Whether the input is split up, in which case diagnostics are collected in sync rather than reported
+    bool isChunked;
+    Arena *arena;
+    Arena chunkArena;
+    Tokenizer tokenizer;
+    // In source order
+    Struct *firstStruct;
+    Enum *firstEnum;
+    uint64_t tokenCounts[TokenType_End + 1];
+    ChunkSync sync;
+};
+
+// Below this a thread costs more than it saves, even with the skip scan's speed
+static const int parseChunkMinimumSize = 1024 * 1024;
+// Threads beyond one per input go to splitting up large inputs, see parseAllFiles
+static int threadsPerInput = 1;
+
+static void
+parseChunkTokens(ParseChunk *chunk) {
+    Tokenizer *tokenizer = &chunk->tokenizer;
+    initTokenizer(tokenizer, &chunk->input->file);
+    tokenizer->at += chunk->begin;
+    if (printStats) {
+        tokenizer->tokenCounts = chunk->tokenCounts;
+    }
+
+    bool isParsing = true;
+
+    Struct *firstStruct = nullptr;
+    Enum *firstEnum = nullptr;
+
+    while (isParsing) {
+        if (skipScan) {
+            skipToIntrospect(tokenizer);
+            if (chunkSync && tokenizer->at - tokenizer->start >= chunkSync->limit) break;
+        }
+        Token token = getToken(tokenizer);
+
+        if (!skipScan && passRestPoint(token.offset)) {
+            // The token belongs to the next chunk, which counts it
+            if (printStats) chunk->tokenCounts[token.type]--;
+            tokenizer->at = tokenizer->start + token.offset;
+            break;
+        }
+
+        switch (token.type) {
+        case TokenType_End:
+            isParsing = false;
+            break;
+
+        case TokenType_Unknown:
+        {
+            TextPosition position = getPosition(tokenizer, &token);
+            warn("[%d:%d] Unknown token \"%.*s\"\n", position.line, position.column, token.text.length, token.text.data);
+            break;
+        }
+
+        case TokenType_Identifier:
+            if (tokenMatchesString(&token, keyword_introspect)) {
+                uint32_t options = parseIntrospectOptions(tokenizer);
+
+                Token introspectType = requireToken(tokenizer, TokenType_Identifier);
+                if (tokenMatchesString(&introspectType, keyword_struct)) {
+                    Struct *s = parseStruct(tokenizer, chunk->arena);
+                    s->options = options;
+                    s->endOffset = (int)(tokenizer->at - tokenizer->start);
+
+                    if (options & IntrospectOption_Flags) {
+                        TextPosition position = getPosition(tokenizer, &s->name);
+                        warn("[%d:%d] Introspect(flags) only applies to enums\n", position.line, position.column);
+                    }
+                    if (!firstStruct) {
+                        firstStruct = s;
+                    } else {
+                        s->next = firstStruct;
+                        firstStruct = s;
+                    }
+                    break;
+                } else if (tokenMatchesString(&introspectType, keyword_enum)) {
+                    Enum *e = parseEnum(tokenizer, chunk->arena);
+                    e->options = options;
+                    e->endOffset = (int)(tokenizer->at - tokenizer->start);
+
+                    if (options & IntrospectOption_Soa) {
+                        TextPosition position = getPosition(tokenizer, &e->name);
+                        warn("[%d:%d] Introspect(soa) only applies to structs\n", position.line, position.column);
+                    }
+                    if (!firstEnum) {
+                        firstEnum = e;
+                    } else {
+                        e->next = firstEnum;
+                        firstEnum = e;
+                    }
+                } else {
+                    TextPosition position = getPosition(tokenizer, &introspectType);
+                    fatal("[%d:%d] Unknown introspection target \"%.*s\"\n", position.line, position.column, 
+                            introspectType.text.length, introspectType.text.data);
+                }
+            }
+
+        default:
+            break;
+        }
+    }
+
+    // Keep everything in source order so the merged output doesn't depend on how the work was scheduled
+    reverse(&firstStruct);
+    reverse(&firstEnum);
+
+    chunk->firstStruct = firstStruct;
+    chunk->firstEnum = firstEnum;
+    chunk->end = (int)(tokenizer->at - tokenizer->start);
+}
+
+static void
+runParseChunk(ParseChunk *chunk) {
+    double start = printStats ? getSeconds() : 0;
+
+    if (chunk->isChunked) {
+        // fatal() comes back here having logged the error, which parseChunks reports if it turns out to be real
+        chunkSync = &chunk->sync;
+        if (setjmp(chunk->sync.jump) == 0) {
+            parseChunkTokens(chunk);
+        }
+        chunkSync = nullptr;
+    } else {
+        parseChunkTokens(chunk);
+    }
+
+    freeTokenizer(&chunk->tokenizer);
+
+    if (printStats) {
+        addElapsedNanoseconds(&phaseStats.parseNanoseconds, start);
+    }
+}
+
+static void
+freeDiagnostics(ChunkSync *sync) {
+    Diagnostic *diagnostic = sync->firstDiagnostic;
+    while (diagnostic) {
+        Diagnostic *next = diagnostic->next;
+        free(diagnostic->message);
+        free(diagnostic);
+        diagnostic = next;
+    }
+    sync->firstDiagnostic = nullptr;
+}
+
+/*
+ * The tokenizer and the parser are interleaved, so for --stats the tokenizer's share is timed with a second pass on
+ * its own. When skipping that's just the scan, the definitions themselves count as parsing.
+ */
+static void
+timeTokenizer(InputFile *input, int begin, int end, bool isChunked) {
+    FileData part = {};
+    part.data = input->file.data + begin;
+    part.size = end - begin;
+
+    double start = getSeconds();
+
+    // A chunk can start or end in the middle of a literal, which is an error here that doesn't matter
+    ChunkSync sync = {};
+    sync.limit = INT_MAX;
+    if (isChunked) {
+        chunkSync = &sync;
+    }
+
+    Tokenizer tokenizer;
+    initTokenizer(&tokenizer, &part);
+    if (!isChunked || setjmp(sync.jump) == 0) {
+        if (skipScan) {
+            skipScanAll(&tokenizer);
+        } else {
+            tokenizeAll(&tokenizer);
+        }
+    }
+    freeTokenizer(&tokenizer);
+
+    chunkSync = nullptr;
+    freeDiagnostics(&sync);
+    free(sync.restPoints);
+
+    addElapsedNanoseconds(&phaseStats.tokenizeNanoseconds, start);
+}
+
+static void *
+parseChunkWorker(void *data) {
+    ParseChunk *chunk = (ParseChunk *)data;
+    runParseChunk(chunk);
+
+    if (printStats) {
+        int size = (int)chunk->input->file.size;
+        timeTokenizer(chunk->input, chunk->begin, chunk->sync.limit < size ? chunk->sync.limit : size, true);
+    }
+    return nullptr;
+}
+
+static bool
+isRestPoint(ChunkSync *sync, int offset) {
+    int low = 0;
+    int high = sync->restPointCount - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (sync->restPoints[middle] == offset) return true;
+        if (sync->restPoints[middle] < offset) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return false;
+}
+
+/*
+ * Parses a large input on several threads at once by splitting it into chunks at line starts. A chunk can start
+ * inside a comment, literal or definition without knowing it, so each is parsed as if it didn't and they're checked
+ * as they're stitched back together in order. A chunk stops at its first rest point past the start of the next one.
+ * The next chunk is kept from that point on if it passed the same rest point, as from there both parse exactly the
+ * same way, which nearly always happens within a line. Otherwise it's parsed again from where the previous one
+ * stopped. Either way the structs, enums, warnings and errors are exactly what a serial parse finds.
+ */
+static void
+parseChunks(InputFile *input, int startOffset, int chunkCount, Struct **firstStruct, Enum **firstEnum, 
+            uint64_t *tokenCounts) {
+    // openFile refuses anything over INT_MAX bytes, so every offset and limit here fits in an int
+    int size = (int)input->file.size;
+    const char *data = input->file.data;
+
+    ParseChunk *chunks = (ParseChunk *)calloc(chunkCount, sizeof(ParseChunk));
+
+    int begin = startOffset;
+    for (int i = 0; i < chunkCount; i++) {
+        ParseChunk *chunk = chunks + i;
+        chunk->input = input;
+        chunk->isChunked = true;
+        chunk->arena = &chunk->chunkArena;
+        chunk->begin = begin;
+
+        if (i + 1 < chunkCount) {
+            int64_t target = startOffset + (int64_t)(size - startOffset) * (i + 1) / chunkCount;
+            if (target < begin) target = begin;
+            const char *newline = (const char *)memchr(data + target, '\n', size - target);
+            begin = newline ? (int)(newline + 1 - data) : size;
+            chunk->sync.limit = begin;
+        } else {
+            chunk->sync.limit = INT_MAX;
+        }
+        // The first chunk starts where a serial parse would, so there's nothing to check it against. The previous
+        // chunk usually stops within a line of where the others start, but can run on through a long comment or
+        // definition, so their rest points are kept all the way to their own limit.
+        chunk->sync.windowEnd = i == 0 ? chunk->begin : chunk->sync.limit;
+    }
+
+    // The calling thread parses the first chunk
+    pthread_t *threads = (pthread_t *)calloc(chunkCount - 1, sizeof(pthread_t));
+    for (int i = 1; i < chunkCount; i++) {
+        if (pthread_create(threads + i - 1, nullptr, parseChunkWorker, chunks + i) != 0) {
+            fatal("Could not create worker thread\n");
+        }
+    }
+
+    parseChunkWorker(chunks);
+
+    for (int i = 1; i < chunkCount; i++) {
+        pthread_join(threads[i - 1], nullptr);
+    }
+    free(threads);
+
+    Struct **structTail = firstStruct;
+    Enum **enumTail = firstEnum;
+    Diagnostic *error = nullptr;
+    // Where the parse so far stopped, the previous chunk's rest point that this one has to have passed too
+    int stitch = startOffset;
+
+    for (int i = 0; i < chunkCount && !error; i++) {
+        ParseChunk *chunk = chunks + i;
+
+        if (i > 0 && !isRestPoint(&chunk->sync, stitch)) {
+            freeDiagnostics(&chunk->sync);
+            memset(chunk->tokenCounts, 0, sizeof(chunk->tokenCounts));
+            chunk->firstStruct = nullptr;
+            chunk->firstEnum = nullptr;
+            chunk->begin = stitch;
+            chunk->sync.windowEnd = stitch;
+            runParseChunk(chunk);
+        } else if (i > 0 && printStats) {
+            // The previous chunk counted the tokens before the stitch, so parse that bit again to take them off
+            ParseChunk overlap = {};
+            overlap.input = input;
+            overlap.isChunked = true;
+            overlap.arena = &overlap.chunkArena;
+            overlap.begin = chunk->begin;
+            overlap.sync.limit = stitch;
+            runParseChunk(&overlap);
+
+            for (int type = 0; type <= TokenType_End; type++) {
+                chunk->tokenCounts[type] -= overlap.tokenCounts[type];
+            }
+            freeDiagnostics(&overlap.sync);
+            arenaFree(&overlap.chunkArena);
+        }
+
+        reverse(&chunk->sync.firstDiagnostic);
+        for (Diagnostic *diagnostic = chunk->sync.firstDiagnostic; diagnostic; diagnostic = diagnostic->next) {
+            if (diagnostic->offset < stitch) continue;
+            if (diagnostic->isFatal) {
+                error = diagnostic;
+                break;
+            }
+            warn("%s", diagnostic->message);
+        }
+        if (error) break;
+
+        Struct *s = chunk->firstStruct;
+        while (s && s->name.offset < stitch) s = s->next;
+        *structTail = s;
+        while (*structTail) structTail = &(*structTail)->next;
+
+        Enum *e = chunk->firstEnum;
+        while (e && e->name.offset < stitch) e = e->next;
+        *enumTail = e;
+        while (*enumTail) enumTail = &(*enumTail)->next;
+
+        for (int type = 0; type <= TokenType_End; type++) {
+            tokenCounts[type] += chunk->tokenCounts[type];
+        }
+
+        stitch = chunk->end;
+    }
+
+    // Keep the error's message, fatal() may not return
+    char *errorMessage = nullptr;
+    if (error) {
+        errorMessage = error->message;
+        error->message = nullptr;
+    }
+
+    for (int i = 0; i < chunkCount; i++) {
+        ParseChunk *chunk = chunks + i;
+        freeDiagnostics(&chunk->sync);
+        free(chunk->sync.restPoints);
+
+        // Whatever was parsed, kept or not, now belongs to the input
+        if (error) {
+            arenaFree(&chunk->chunkArena);
+        } else {
+            arenaAppend(&input->arena, &chunk->chunkArena);
+        }
+    }
+    free(chunks);
+
+    if (errorMessage) {
+        *firstStruct = nullptr;
+        *firstEnum = nullptr;
+        fatal("%s", errorMessage);
+    }
+}
+
+/*
+ * Tokenizes and parses a single already opened input. This only touches the InputFile it's given, so any number of
+ * these can run at once on different files, and a large one is split up further if there are threads to spare.
+ * Parsing can start part way through, at the end of a definition, in which case what's found is added after the
+ * structs and enums already in the input.
+ */
+static void
+parseFile(InputFile *input, int startOffset = 0) {
+    uint64_t tokenCounts[TokenType_End + 1] = {};
+    Struct *firstStruct = nullptr;
+    Enum *firstEnum = nullptr;
+
+    int chunkCount = (int)((input->file.size - startOffset) / parseChunkMinimumSize);
+    if (chunkCount > threadsPerInput) chunkCount = threadsPerInput;
+
+    if (chunkCount > 1) {
+        parseChunks(input, startOffset, chunkCount, &firstStruct, &firstEnum, tokenCounts);
+    } else {
+        ParseChunk chunk = {};
+        chunk.input = input;
+        chunk.arena = &input->arena;
+        chunk.begin = startOffset;
+        chunk.sync.limit = INT_MAX;
+        runParseChunk(&chunk);
+
+        firstStruct = chunk.firstStruct;
+        firstEnum = chunk.firstEnum;
+        memcpy(tokenCounts, chunk.tokenCounts, sizeof(tokenCounts));
+
+        if (printStats) {
+            timeTokenizer(input, startOffset, (int)input->file.size, false);
+        }
+    }
+
+    Struct **structTail = &input->firstStruct;
+    while (*structTail) structTail = &(*structTail)->next;
+    *structTail = firstStruct;
+
+    Enum **enumTail = &input->firstEnum;
+    while (*enumTail) enumTail = &(*enumTail)->next;
+    *enumTail = firstEnum;
+
+    input->hasOffsets = true;
+
+    if (printStats) {
+        for (int type = 0; type <= TokenType_End; type++) {
+            __atomic_fetch_add(&phaseStats.tokenCounts[type], tokenCounts[type], __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&phaseStats.parsedFileCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Cache
+ *
+ * The parsed model of every input is kept in a binary cache file along with the input's size, modification time
+ * and content hash. An input whose size and modification time still match is loaded from the cache without being
+ * read at all, one whose contents hash the same is loaded without being tokenized. Strings in a loaded model point
+ * straight into the mapped cache file, so it stays mapped until we're done.
+ *
+ * Bump cacheVersion whenever the model or the encoding below changes.
+ */
+
+static const uint32_t cacheMagic = 0x4354454d; // "METC"
+static const uint32_t cacheVersion = 4;
+
+struct CacheEntry {
+    String fileName;
+    FileStamp stamp;
+    const char *model;
+    size_t modelSize;
+};
+
+struct Cache {
+    FileData file;
+    CacheEntry *entries;
+    int count;
+    // File name to entry index
+    StringHash index;
+    bool isDirty;
+};
+
+static Cache cache = {};
+static bool useCache = false;
+
+struct CacheReader {
+    const char *at;
+    const char *end;
+    bool failed;
+};
+
+static const char *
+readBytes(CacheReader *reader, size_t size) {
+    if (reader->failed || (size_t)(reader->end - reader->at) < size) {
+        reader->failed = true;
+        return nullptr;
+    }
+    const char *result = reader->at;
+    reader->at += size;
+    return result;
+}
+
+static uint32_t
+readU32(CacheReader *reader) {
+    uint32_t value = 0;
+    const char *bytes = readBytes(reader, sizeof(value));
+    if (bytes) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static uint64_t
+readU64(CacheReader *reader) {
+    uint64_t value = 0;
+    const char *bytes = readBytes(reader, sizeof(value));
+    if (bytes) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static uint32_t
+readVarint(CacheReader *reader) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const char *byte = readBytes(reader, 1);
+        if (!byte) break;
+        value |= (uint32_t)(*byte & 0x7f) << shift;
+        if (!(*byte & 0x80)) return value;
+    }
+    reader->failed = true;
+    return 0;
+}
+
+static uint8_t
+readU8(CacheReader *reader) {
+    const char *byte = readBytes(reader, 1);
+    return byte ? (uint8_t)*byte : 0;
+}
+
+static String
+readString(CacheReader *reader) {
+    String result = {};
+    result.length = readVarint(reader);
+    result.data = readBytes(reader, result.length);
+    if (!result.data) result.length = 0;
+    return result;
+}
+
+static Token
+readToken(CacheReader *reader) {
+    Token token = {};
+    uint8_t type = readU8(reader);
+    if (type > TokenType_End) reader->failed = true;
+    else token.type = (TokenType)type;
+    token.text = readString(reader);
+    return token;
+}
+
+/*
+ * Counts and string lengths are almost always tiny, so they're stored 7 bits at a time.
+ */
+static void
+writeVarint(OutputBuffer *buffer, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        bufferAppend(buffer, &byte, 1);
+    } while (value);
+}
+
+static void
+writeU8(OutputBuffer *buffer, uint8_t value) {
+    bufferAppend(buffer, &value, 1);
+}
+
+static void
+writeU32(OutputBuffer *buffer, uint32_t value) {
+    bufferAppend(buffer, &value, sizeof(value));
+}
+
+static void
+writeU64(OutputBuffer *buffer, uint64_t value) {
+    bufferAppend(buffer, &value, sizeof(value));
+}
+
+static void
+writeString(OutputBuffer *buffer, String *str) {
+    writeVarint(buffer, str->length);
+    bufferAppend(buffer, str->data, str->length);
+}
+
+static void
+writeToken(OutputBuffer *buffer, Token *token) {
+    writeU8(buffer, token->type);
+    writeString(buffer, &token->text);
+}
+
+static void
+writeModel(OutputBuffer *buffer, InputFile *input) {
+    uint32_t structCount = 0;
+    for (Struct *s = input->firstStruct; s; s = s->next) structCount++;
+    writeVarint(buffer, structCount);
+
+    for (Struct *s = input->firstStruct; s; s = s->next) {
+        writeToken(buffer, &s->name);
+        writeVarint(buffer, s->options);
+        writeVarint(buffer, s->memberCount);
+        for (StructMember *member = s->firstMember; member; member = member->next) {
+            writeToken(buffer, &member->type);
+            writeToken(buffer, &member->name);
+            writeU8(buffer, (member->isPointer ? 1 : 0) | (member->isArray ? 2 : 0));
+            writeToken(buffer, &member->arraySize);
+        }
+    }
+
+    uint32_t enumCount = 0;
+    for (Enum *e = input->firstEnum; e; e = e->next) enumCount++;
+    writeVarint(buffer, enumCount);
+
+    for (Enum *e = input->firstEnum; e; e = e->next) {
+        writeToken(buffer, &e->name);
+        writeVarint(buffer, e->options);
+        writeVarint(buffer, e->memberCount);
+        for (EnumMember *member = e->firstMember; member; member = member->next) {
+            writeToken(buffer, &member->name);
+            writeU8(buffer, member->isValueKnown);
+            writeU64(buffer, member->value);
+        }
+    }
+}
+
+/*
+ * Rebuilds the struct and enum lists for an input from its cache entry, in the same order parsing produced them.
+ */
+static bool
+readModel(CacheEntry *entry, InputFile *input) {
+    CacheReader reader = {};
+    reader.at = entry->model;
+    reader.end = entry->model + entry->modelSize;
+
+    Struct **nextStruct = &input->firstStruct;
+    uint32_t structCount = readVarint(&reader);
+    for (uint32_t i = 0; i < structCount && !reader.failed; i++) {
+        Struct *s = pushStruct(&input->arena, Struct);
+        s->name = readToken(&reader);
+        s->options = readVarint(&reader);
+        s->memberCount = readVarint(&reader);
+
+        StructMember **nextMember = &s->firstMember;
+        for (int j = 0; j < s->memberCount && !reader.failed; j++) {
+            StructMember *member = pushStruct(&input->arena, StructMember);
+            member->type = readToken(&reader);
+            member->name = readToken(&reader);
+            uint8_t flags = readU8(&reader);
+            member->isPointer = (flags & 1) != 0;
+            member->isArray = (flags & 2) != 0;
+            member->arraySize = readToken(&reader);
+
+            *nextMember = member;
+            nextMember = &member->next;
+        }
+
+        *nextStruct = s;
+        nextStruct = &s->next;
+    }
+
+    Enum **nextEnum = &input->firstEnum;
+    uint32_t enumCount = readVarint(&reader);
+    for (uint32_t i = 0; i < enumCount && !reader.failed; i++) {
+        Enum *e = pushStruct(&input->arena, Enum);
+        e->name = readToken(&reader);
+        e->options = readVarint(&reader);
+        e->memberCount = readVarint(&reader);
+
+        EnumMember **nextMember = &e->firstMember;
+        for (int j = 0; j < e->memberCount && !reader.failed; j++) {
+            EnumMember *member = pushStruct(&input->arena, EnumMember);
+            member->name = readToken(&reader);
+            member->isValueKnown = readU8(&reader) != 0;
+            member->value = (int64_t)readU64(&reader);
+
+            *nextMember = member;
+            nextMember = &member->next;
+        }
+
+        *nextEnum = e;
+        nextEnum = &e->next;
+    }
+
+    if (reader.failed) {
+        input->firstStruct = nullptr;
+        input->firstEnum = nullptr;
+    }
+
+    return !reader.failed;
+}
+
+/*
+ * Loads the cache if it exists. A cache that is unreadable or from another version is ignored and rebuilt.
+ */
+static void
+loadCache(const char *fileName) {
+    useCache = true;
+    cache.isDirty = true;
+
+    if (access(fileName, F_OK) != 0) return;
+
+    cache.file = openFile(fileName);
+
+    CacheReader reader = {};
+    reader.at = cache.file.data;
+    reader.end = cache.file.data + cache.file.size;
+
+    if (readU32(&reader) != cacheMagic || readU32(&reader) != cacheVersion) {
+        return;
+    }
+
+    // Every entry takes at least a byte for the name length and five 64-bit fields, so a count that the rest of the
+    // file couldn't hold is corrupt, and is never used to size an allocation
+    uint32_t count = readU32(&reader);
+    if (count > (size_t)(reader.end - reader.at) / (1 + 5 * sizeof(uint64_t))) reader.failed = true;
+
+    if (!reader.failed) {
+        cache.entries = (CacheEntry *)calloc(count ? count : 1, sizeof(CacheEntry));
+        if (!cache.entries) reader.failed = true;
+    }
+
+    for (int i = 0; i < (int)count && !reader.failed; i++) {
+        CacheEntry *entry = cache.entries + i;
+        entry->fileName = readString(&reader);
+        entry->stamp.size = readU64(&reader);
+        entry->stamp.modifiedSeconds = readU64(&reader);
+        entry->stamp.modifiedNanoseconds = readU64(&reader);
+        entry->stamp.contentHash = readU64(&reader);
+        entry->modelSize = readU64(&reader);
+        entry->model = readBytes(&reader, entry->modelSize);
+
+        if (!reader.failed && stringHashPut(&cache.index, &entry->fileName) != i) {
+            // Duplicate file name, the cache wasn't written by us
+            reader.failed = true;
+        }
+    }
+
+    if (reader.failed) {
+        warn("Ignoring corrupt cache %s\n", fileName);
+        free(cache.entries);
+        stringHashFree(&cache.index);
+        cache.entries = nullptr;
+        return;
+    }
+
+    cache.count = count;
+    cache.isDirty = false;
+}
+
+static CacheEntry *
+findCacheEntry(const char *fileName) {
+    String name = {};
+    name.length = strlen(fileName);
+    name.data = fileName;
+
+    int index = stringHashFind(&cache.index, &name);
+    return index >= 0 ? cache.entries + index : nullptr;
+}
+
+/*
+ * Rewrites the cache from the current inputs if anything about them changed. Inputs that are no longer passed in are
+ * dropped.
+ */
+static void
+saveCache(const char *fileName, InputList *inputs) {
+    if (!cache.isDirty && cache.count == inputs->count) return;
+
+    OutputBuffer buffer = {};
+    writeU32(&buffer, cacheMagic);
+    writeU32(&buffer, cacheVersion);
+
+    size_t countOffset = buffer.size;
+    writeU32(&buffer, 0);
+
+    uint32_t count = 0;
+    for (int i = 0; i < inputs->count; i++) {
+        InputFile *input = inputs->files + i;
+        if (!input->isCacheable) continue;
+
+        String name = {};
+        name.length = strlen(input->fileName);
+        name.data = input->fileName;
+
+        writeString(&buffer, &name);
+        writeU64(&buffer, input->stamp.size);
+        writeU64(&buffer, input->stamp.modifiedSeconds);
+        writeU64(&buffer, input->stamp.modifiedNanoseconds);
+        writeU64(&buffer, input->stamp.contentHash);
+
+        size_t modelSizeOffset = buffer.size;
+        writeU64(&buffer, 0);
+        writeModel(&buffer, input);
+
+        uint64_t modelSize = buffer.size - modelSizeOffset - sizeof(uint64_t);
+        memcpy(buffer.data + modelSizeOffset, &modelSize, sizeof(modelSize));
+        count++;
+    }
+
+    memcpy(buffer.data + countOffset, &count, sizeof(count));
+
+    writeFile(fileName, buffer.data, buffer.size);
+    free(buffer.data);
+}
+
+static void
+freeCache() {
+    closeFile(&cache.file);
+    free(cache.entries);
+    stringHashFree(&cache.index);
+    cache = {};
+}
+
+static void
+openInputFile(InputFile *input) {
+    double start = printStats ? getSeconds() : 0;
+    input->file = openFile(input->fileName);
+    if (printStats) {
+        addElapsedNanoseconds(&phaseStats.readNanoseconds, start);
+    }
+}
+
+/*
+ * Gets the model for an input, from the cache if possible, otherwise by parsing it.
+ */
+static void
+loadInput(InputFile *input) {
+    bool isStdin = strcmp(input->fileName, "-") == 0;
+
+    if (!useCache || isStdin) {
+        openInputFile(input);
+        parseFile(input);
+        return;
+    }
+
+    struct stat fileStat;
+    if (stat(input->fileName, &fileStat) != 0) 
+        fatal("Could not open %s for reading\n", input->fileName);
+
+    input->isCacheable = S_ISREG(fileStat.st_mode);
+    input->stamp.size = fileStat.st_size;
+    input->stamp.modifiedSeconds = fileStat.st_mtime;
+    input->stamp.modifiedNanoseconds = statModifiedNanoseconds(fileStat);
+
+    CacheEntry *entry = input->isCacheable ? findCacheEntry(input->fileName) : nullptr;
+
+    if (entry && entry->stamp.size == input->stamp.size && 
+            entry->stamp.modifiedSeconds == input->stamp.modifiedSeconds && 
+            entry->stamp.modifiedNanoseconds == input->stamp.modifiedNanoseconds) {
+        input->stamp.contentHash = entry->stamp.contentHash;
+        if (readModel(entry, input)) {
+            if (printStats) __atomic_fetch_add(&phaseStats.cachedFileCount, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    // Only the timestamp changed, or this is new. Either way the cache needs rewriting.
+    __atomic_store_n(&cache.isDirty, true, __ATOMIC_RELAXED);
+
+    openInputFile(input);
+    input->stamp.contentHash = fnv1_hash(input->file.data, input->file.size);
+
+    if (entry && entry->stamp.size == input->file.size && entry->stamp.contentHash == input->stamp.contentHash) {
+        if (readModel(entry, input)) {
+            if (printStats) __atomic_fetch_add(&phaseStats.cachedFileCount, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    parseFile(input);
+}
+
+/*
+ * Dependency file
+ */
+
+static void
+writeDepfilePath(OutputBuffer *buffer, const char *path) {
+    for (const char *at = path; *at; at++) {
+        if (*at == ' ' || *at == '#' || *at == '\\') {
+            bufferAppend(buffer, "\\", 1);
+        } else if (*at == '$') {
+            bufferAppend(buffer, "$", 1);
+        }
+        bufferAppend(buffer, at, 1);
+    }
+}
+
+/*
+ * Writes a Make/Ninja style depfile saying that the output depends on every input and response file.
+ */
+static void
+writeDepfile(const char *depfileName, const char *target, InputList *inputs) {
+    OutputBuffer buffer = {};
+
+    writeDepfilePath(&buffer, target);
+    bufferAppend(&buffer, ":", 1);
+
+    for (int i = 0; i < inputs->dependencyCount; i++) {
+        if (strcmp(inputs->dependencies[i], "-") == 0) continue;
+
+        bufferAppend(&buffer, " \\\n  ", 4);
+        writeDepfilePath(&buffer, inputs->dependencies[i]);
+    }
+    bufferAppend(&buffer, "\n", 1);
+
+    if (!fileHasContents(depfileName, buffer.data, buffer.size)) {
+        writeFile(depfileName, buffer.data, buffer.size);
+    }
+    free(buffer.data);
+}
+
+/*
+ * Worker pool
+ */
+
+struct WorkQueue {
+    InputList *inputs;
+    int nextIndex;
+};
+
+static void *
+parseWorker(void *data) {
+    WorkQueue *queue = (WorkQueue *)data;
+
+    for (;;) {
+        int index = __atomic_fetch_add(&queue->nextIndex, 1, __ATOMIC_RELAXED);
+        if (index >= queue->inputs->count) break;
+
+        loadInput(queue->inputs->files + index);
+    }
+
+    return nullptr;
+}
+
+static void
+parseAllFiles(InputList *inputs, int threadCount) {
+    WorkQueue queue = {};
+    queue.inputs = inputs;
+
+    // Threads beyond one per input go to splitting up large inputs
+    threadsPerInput = threadCount / inputs->count > 1 ? threadCount / inputs->count : 1;
+    if (threadCount > inputs->count) threadCount = inputs->count;
+
+    if (threadCount <= 1) {
+        parseWorker(&queue);
+        return;
+    }
+
+    // The calling thread is one of the workers
+    pthread_t *threads = (pthread_t *)calloc(threadCount - 1, sizeof(pthread_t));
+    for (int i = 0; i < threadCount - 1; i++) {
+        if (pthread_create(threads + i, nullptr, parseWorker, &queue) != 0) {
+            fatal("Could not create worker thread\n");
+        }
+    }
+
+    parseWorker(&queue);
+
+    for (int i = 0; i < threadCount - 1; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+    free(threads);
+}
+
+/*
+ * Layout
+ *
+ * --layout-report works out struct layouts itself rather than asking a compiler, so it assumes an LP64 ABI:
+ * primitives are aligned to their size, pointers, long and size_t are 8 bytes, wchar_t is 4 and enums are ints. That
+ * makes it an estimate, the generated metadata uses sizeof and alignof and can disagree on other targets, like LLP64
+ * where long is 4 bytes and wchar_t is 2. The report says so at the top. Members of types it can't size, like structs
+ * that aren't introspected, make the layout of the whole struct unknown.
+ */
+
+static const int cacheLineSize = 64;
+
+struct MemberLayout {
+    StructMember *member;
+    int index;
+    int64_t offset;
+    int64_t size;
+    int64_t alignment;
+};
+
+struct StructLayout {
+    // Set once the layout has been worked out, or is being worked out, so it's only done once per struct
+    bool isVisited;
+    bool isKnown;
+    int64_t size;
+    int64_t alignment;
+    MemberLayout *members;
+    // The first type we couldn't size when isKnown is false
+    Token unknownType;
+};
+
+struct LayoutContext {
+    StringHash typeNames;
+    // Indexed by the IDs in typeNames, structs is null for enums
+    Struct **structs;
+    StructLayout *layouts;
+    int capacity;
+};
+
+static int64_t
+alignUp(int64_t value, int64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void computeStructLayout(LayoutContext *context, int id);
+
+static bool
+getTypeLayout(LayoutContext *context, Token *type, int64_t *size, int64_t *alignment) {
+    for (int i = 0; i < arrayLength(primitiveLayouts); i++) {
+        if (tokenMatchesString(type, primitiveLayouts[i].name)) {
+            *size = *alignment = primitiveLayouts[i].size;
+            return true;
+        }
+    }
+
+    int id = stringHashFind(&context->typeNames, &type->text);
+    if (id < 0) return false;
+
+    if (!context->structs[id]) {
+        *size = *alignment = 4;
+        return true;
+    }
+
+    computeStructLayout(context, id);
+    StructLayout *layout = context->layouts + id;
+    *size = layout->size;
+    *alignment = layout->alignment;
+    return layout->isKnown;
+}
+
+/*
+ * Lays members out in the given order, returning the size of the struct.
+ */
+static int64_t
+layoutMembers(MemberLayout *members, int count, int64_t *alignment) {
+    int64_t offset = 0;
+    *alignment = 1;
+    for (int i = 0; i < count; i++) {
+        offset = alignUp(offset, members[i].alignment);
+        members[i].offset = offset;
+        offset += members[i].size;
+        if (members[i].alignment > *alignment) *alignment = members[i].alignment;
+    }
+    return alignUp(offset > 0 ? offset : 1, *alignment);
+}
+
+static void
+computeStructLayout(LayoutContext *context, int id) {
+    StructLayout *layout = context->layouts + id;
+    if (layout->isVisited) return;
+    layout->isVisited = true;
+
+    Struct *s = context->structs[id];
+    layout->members = (MemberLayout *)calloc(s->memberCount ? s->memberCount : 1, sizeof(MemberLayout));
+
+    int index = 0;
+    for (StructMember *member = s->firstMember; member; member = member->next, index++) {
+        MemberLayout *memberLayout = layout->members + index;
+        memberLayout->member = member;
+        memberLayout->index = index;
+
+        bool isKnown;
+        if (member->isPointer) {
+            memberLayout->size = memberLayout->alignment = 8;
+            isKnown = true;
+        } else {
+            isKnown = getTypeLayout(context, &member->type, &memberLayout->size, &memberLayout->alignment);
+        }
+
+        if (isKnown && member->isArray) {
+            int64_t count = 0;
+            isKnown = member->arraySize.type == TokenType_Number && parseIntegerLiteral(&member->arraySize, &count);
+            memberLayout->size *= count;
+        }
+
+        if (!isKnown) {
+            layout->unknownType = member->isArray && member->arraySize.type != TokenType_Number ? member->arraySize 
+                                                                                                 : member->type;
+            return;
+        }
+    }
+
+    layout->size = layoutMembers(layout->members, s->memberCount, &layout->alignment);
+    layout->isKnown = true;
+}
+
+static int
+compareMemberAlignment(const void *a, const void *b) {
+    const MemberLayout *left = (const MemberLayout *)a;
+    const MemberLayout *right = (const MemberLayout *)b;
+    if (left->alignment != right->alignment) return left->alignment > right->alignment ? -1 : 1;
+    // Keep the declaration order otherwise, qsort isn't stable
+    return left->index - right->index;
+}
+
+static void
+printStructLayout(LayoutContext *context, int id) {
+    Struct *s = context->structs[id];
+    StructLayout *layout = context->layouts + id;
+
+    if (!layout->isKnown) {
+        printf("%.*s: unknown layout, can't size \"%.*s\"\n\n", s->name.text.length, s->name.text.data,
+               layout->unknownType.text.length, layout->unknownType.text.data);
+        return;
+    }
+
+    int64_t padding = layout->size;
+    for (int i = 0; i < s->memberCount; i++) padding -= layout->members[i].size;
+
+    printf("%.*s: %lld bytes, aligned to %lld, %lld bytes of padding\n", s->name.text.length, s->name.text.data,
+           (long long)layout->size, (long long)layout->alignment, (long long)padding);
+    printf("    %8s %8s %8s  %s\n", "offset", "size", "align", "member");
+
+    for (int i = 0; i < s->memberCount; i++) {
+        MemberLayout *member = layout->members + i;
+        int64_t end = member->offset + member->size;
+        int64_t next = i + 1 < s->memberCount ? layout->members[i + 1].offset : layout->size;
+
+        printf("    %8lld %8lld %8lld  %.*s", (long long)member->offset, (long long)member->size, 
+               (long long)member->alignment, member->member->name.text.length, member->member->name.text.data);
+
+        // Members bigger than a line have to straddle, only flag the ones that didn't need to
+        if (member->size <= cacheLineSize && member->size > 0 && 
+            member->offset / cacheLineSize != (end - 1) / cacheLineSize) {
+            printf("  (straddles a cache line)");
+        }
+        printf("\n");
+
+        if (next > end) {
+            printf("    %8lld %8lld %8s  (padding)\n", (long long)end, (long long)(next - end), "");
+        }
+    }
+
+    MemberLayout *sorted = (MemberLayout *)malloc((s->memberCount ? s->memberCount : 1) * sizeof(MemberLayout));
+    memcpy(sorted, layout->members, s->memberCount * sizeof(MemberLayout));
+    qsort(sorted, s->memberCount, sizeof(MemberLayout), compareMemberAlignment);
+
+    int64_t sortedAlignment;
+    int64_t sortedSize = layoutMembers(sorted, s->memberCount, &sortedAlignment);
+    if (sortedSize < layout->size) {
+        printf("    Reordering to");
+        for (int i = 0; i < s->memberCount; i++) {
+            printf("%s %.*s", i ? "," : "", sorted[i].member->name.text.length, sorted[i].member->name.text.data);
+        }
+        printf(" would make it %lld bytes\n", (long long)sortedSize);
+    }
+    printf("\n");
+
+    free(sorted);
+}
+
+static void
+printLayoutReport(InputList *inputs) {
+    LayoutContext context = {};
+
+    printf("Layouts estimated for an LP64 ABI (pointers, long and size_t are 8 bytes, wchar_t and enums are 4),\n"
+           "they may not match the compiler's on other targets.\n\n");
+
+    for (int i = 0; i < inputs->count; i++) {
+        int count = 0;
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) count++;
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) count++;
+        context.capacity += count;
+    }
+
+    context.structs = (Struct **)calloc(context.capacity ? context.capacity : 1, sizeof(Struct *));
+    context.layouts = (StructLayout *)calloc(context.capacity ? context.capacity : 1, sizeof(StructLayout));
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            stringHashPut(&context.typeNames, &e->name.text);
+        }
+    }
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            context.structs[stringHashPut(&context.typeNames, &s->name.text)] = s;
+        }
+    }
+
+    for (int id = 0; id < context.typeNames.count; id++) {
+        if (!context.structs[id]) continue;
+        computeStructLayout(&context, id);
+        printStructLayout(&context, id);
+    }
+
+    for (int id = 0; id < context.typeNames.count; id++) {
+        free(context.layouts[id].members);
+    }
+    free(context.structs);
+    free(context.layouts);
+    stringHashFree(&context.typeNames);
+}
+
+/*
+ * Benchmarking
+ */
+
+/*
+ * Runs pass over every input repeatedly for at least half a second, after a warm up run for the page cache and the
+ * branch predictors, and returns the seconds per run.
+ */
+static double
+timeInputPasses(InputList *inputs, int (*pass)(FileData *file), int *count) {
+    *count = 0;
+    for (int i = 0; i < inputs->count; i++) {
+        *count += pass(&inputs->files[i].file);
+    }
+
+    int iterations = 0;
+    double start = getSeconds();
+    double elapsed = 0;
+    do {
+        for (int i = 0; i < inputs->count; i++) {
+            pass(&inputs->files[i].file);
+        }
+        iterations++;
+        elapsed = getSeconds() - start;
+    } while (elapsed < 0.5);
+
+    return elapsed / iterations;
+}
+
+/*
+ * Tokenizes every input repeatedly with each scanner this CPU supports and reports the throughput, along with the
+ * throughput of the skip scan that finds the Introspect markers. Scalar is the byte at a time baseline.
+ */
+static void
+benchmarkTokenizer(InputList *inputs) {
+    size_t totalSize = 0;
+    for (int i = 0; i < inputs->count; i++) {
+        inputs->files[i].file = openFile(inputs->files[i].fileName);
+        totalSize += inputs->files[i].file.size;
+    }
+
+    printf("%-8s %12s %10s %10s %10s\n", "scanner", "tokens", "seconds", "MB/s", "skip MB/s");
+
+    for (int kind = ScannerKind_Scalar; kind < ScannerKind_Count; kind++) {
+        if (!scannerIsSupported((ScannerKind)kind)) continue;
+        initScanner((ScannerKind)kind);
+
+        int tokenCount;
+        double seconds = timeInputPasses(inputs, tokenizeOnly, &tokenCount);
+        int markerCount;
+        double skipSeconds = timeInputPasses(inputs, skipScanOnly, &markerCount);
+
+        double megabytes = totalSize / (1024.0 * 1024.0);
+        printf("%-8s %12d %10.4f %10.1f %10.1f\n", scannerKindNames[kind], tokenCount, seconds, megabytes / seconds, 
+               megabytes / skipSeconds);
+    }
+}
+
+/*
+ * Main
+ */
+
+/*
+ * Types are interned on one thread after parsing, in input order, so Meta_Type is identical regardless of the number
+ * of threads.
+ */
+static void
+internTypes(InputList *inputs) {
+    for (int i = 0; i < inputs->count; i++) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            stringHashPut(&structNames, &s->name.text);
+            usedIntrospectOptions |= s->options;
+            for (StructMember *member = s->firstMember; member; member = member->next) {
+                stringHashPut(&stringHash, &member->type.text);
+            }
+        }
+
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            stringHashPut(&enumNames, &e->name.text);
+            usedIntrospectOptions |= e->options;
+        }
+    }
+
+    // The registry needs a Meta_Type for every introspected type, not just the ones used as members. They go after
+    // the member types so those keep the same values either way.
+    if (generateRegistry) {
+        for (int i = 0; i < inputs->count; i++) {
+            for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+                stringHashPut(&stringHash, &s->name.text);
+            }
+            for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+                stringHashPut(&stringHash, &e->name.text);
+            }
+        }
+    }
+
+    if (constTables) {
+        String empty = {};
+        empty.data = "";
+        stringPoolAdd(&empty);
+
+        for (int i = 0; i < inputs->count; i++) {
+            for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+                stringPoolAdd(&s->name.text);
+                for (StructMember *member = s->firstMember; member; member = member->next) {
+                    stringPoolAdd(&member->name.text);
+                }
+            }
+
+            for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+                stringPoolAdd(&e->name.text);
+                for (EnumMember *member = e->firstMember; member; member = member->next) {
+                    stringPoolAdd(&member->name.text);
+                }
+            }
+        }
+
+        // The registry names the other member types too
+        if (generateRegistry) {
+            for (int i = 0; i < stringHash.count; i++) {
+                stringPoolAdd(&stringHash.entries[i].value);
+            }
+        }
+    }
+}
+
+static void
+addRegistryMember(TypeRegistry *registry, StringHash *keys, int owner, int index, String *memberName) {
+    String *ownerName = &stringHash.entries[owner].value;
+
+    String key = {};
+    key.length = ownerName->length + 1 + memberName->length;
+    char *data = (char *)malloc(key.length);
+    memcpy(data, ownerName->data, ownerName->length);
+    data[ownerName->length] = '.';
+    memcpy(data + ownerName->length + 1, memberName->data, memberName->length);
+    key.data = data;
+
+    // Repeated member names are the compiler's to complain about, but they'd stop the perfect hash from being built
+    int count = keys->count;
+    int id = stringHashPut(keys, &key);
+    free(data);
+    if (id != count) return;
+
+    if (registry->memberCount == registry->memberCapacity) {
+        registry->memberCapacity = registry->memberCapacity ? registry->memberCapacity * 2 : 256;
+        registry->members = (RegistryMember *)realloc(registry->members, registry->memberCapacity * sizeof(RegistryMember));
+    }
+
+    RegistryMember *member = registry->members + registry->memberCount++;
+    member->owner = owner;
+    member->index = index;
+    member->key = keys->entries[id].value;
+}
+
+/*
+ * Needs the types interned, with --registry that includes the name of every introspected struct and enum.
+ */
+static void
+buildTypeRegistry(TypeRegistry *registry, InputList *inputs) {
+    *registry = {};
+
+    int typeCount = stringHash.count ? stringHash.count : 1;
+    registry->structs = (Struct **)calloc(typeCount, sizeof(Struct *));
+    registry->enums = (Enum **)calloc(typeCount, sizeof(Enum *));
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            int type = stringHashFind(&stringHash, &s->name.text);
+            if (!registry->structs[type]) registry->structs[type] = s;
+        }
+    }
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            int type = stringHashFind(&stringHash, &e->name.text);
+            if (!registry->structs[type] && !registry->enums[type]) registry->enums[type] = e;
+        }
+    }
+
+    StringHash *keys = &registry->memberKeys;
+    for (int type = 0; type < stringHash.count; type++) {
+        int index = 0;
+        if (registry->structs[type]) {
+            for (StructMember *member = registry->structs[type]->firstMember; member; member = member->next) {
+                addRegistryMember(registry, keys, type, index++, &member->name.text);
+            }
+        } else if (registry->enums[type]) {
+            for (EnumMember *member = registry->enums[type]->firstMember; member; member = member->next) {
+                addRegistryMember(registry, keys, type, index++, &member->name.text);
+            }
+        }
+    }
+}
+
+static void
+generateSingleOutput(InputList *inputs, const char *fileName, bool writeIfChanged) {
+    outputPreamble();
+    outputTypesEnum();
+    outputMetaDefinitions(TableLinkage_Global);
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            outputStruct(s);
+        }
+    }
+
+    for (int i = 0; i < inputs->count; i++) {
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            outputEnum(e);
+        }
+    }
+
+    if (generateRegistry) {
+        TypeRegistry registry;
+        buildTypeRegistry(&registry, inputs);
+        outputRegistry(&registry, TableLinkage_Global);
+        freeTypeRegistry(&registry);
+    }
+
+    flushOutput(fileName, writeIfChanged);
+}
+
+/*
+ * The index of the input defining each Meta_Type, or -1 for types that aren't introspected. A name introspected in
+ * more than one input belongs to the first, as in the registry.
+ */
+static int *
+findDefiningInputs(InputList *inputs) {
+    int *result = (int *)malloc((stringHash.count ? stringHash.count : 1) * sizeof(int));
+    for (int type = 0; type < stringHash.count; type++) result[type] = -1;
+
+    // Types only have an ID when something uses them as a member or the registry is generated
+    for (int i = inputs->count - 1; i >= 0; i--) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            int type = stringHashFind(&stringHash, &s->name.text);
+            if (type >= 0) result[type] = i;
+        }
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            int type = stringHashFind(&stringHash, &e->name.text);
+            if (type >= 0) result[type] = i;
+        }
+    }
+    return result;
+}
+
+static const char *splitSharedHeaderName = "meta_types.h";
+static const char *splitRegistryHeaderName = "meta_registry.h";
+
+static char *
+joinPath(Arena *arena, const char *directory, const char *fileName) {
+    size_t directoryLength = strlen(directory);
+    size_t fileNameLength = strlen(fileName);
+
+    char *result = (char *)arenaPush(arena, directoryLength + fileNameLength + 2, 1);
+    memcpy(result, directory, directoryLength);
+    result[directoryLength] = '/';
+    memcpy(result + directoryLength + 1, fileName, fileNameLength + 1);
+    return result;
+}
+
+/*
+ * Input "src/foo.cpp" gets the header "foo.meta.h". Inputs that share a file name get a numeric suffix, in input order
+ * so the names are stable from run to run.
+ */
+static const char *
+splitHeaderName(Arena *arena, StringHash *usedNames, const char *inputFileName) {
+    const char *base = strrchr(inputFileName, '/');
+    base = base ? base + 1 : inputFileName;
+
+    const char *extension = strrchr(base, '.');
+    int stemLength = extension && extension != base ? (int)(extension - base) : (int)strlen(base);
+    if (strcmp(inputFileName, "-") == 0) {
+        base = "stdin";
+        stemLength = 5;
+    }
+
+    char *name = (char *)arenaPush(arena, stemLength + 32, 1);
+    for (int suffix = 1;; suffix++) {
+        if (suffix == 1) {
+            snprintf(name, stemLength + 32, "%.*s.meta.h", stemLength, base);
+        } else {
+            snprintf(name, stemLength + 32, "%.*s_%d.meta.h", stemLength, base, suffix);
+        }
+
+        String nameString = {};
+        nameString.length = strlen(name);
+        nameString.data = name;
+
+        if (stringHashFind(usedNames, &nameString) < 0) {
+            stringHashPut(usedNames, &nameString);
+            break;
+        }
+    }
+
+    return name;
+}
+
+/*
+ * Writes the shared definitions to meta_types.h and the metadata of each input to its own header next to it, so a
+ * translation unit only pulls in the metadata for the types it actually uses. With a source file name the tables are
+ * only declared in the headers and all defined in that one source file, otherwise they're inline variables. Given
+ * isInputChanged, only the headers of the inputs flagged in it are written.
+ */
+static void
+generateSplitOutput(InputList *inputs, const char *directory, const char *sourceFileName, bool writeIfChanged,
+                    bool *isInputChanged = nullptr) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) 
+        fatal("Could not create %s\n", directory);
+
+    TableLinkage linkage = sourceFileName ? TableLinkage_Extern : TableLinkage_Inline;
+
+    outputf("#pragma once\n\n");
+    outputPreamble();
+    outputTypesEnum();
+    outputMetaDefinitions(linkage);
+    // Paths and header names are only needed while generating, --watch calls this for every change
+    Arena names = {};
+    flushOutput(joinPath(&names, directory, splitSharedHeaderName), writeIfChanged);
+    StringHash usedNames = {};
+
+    const char **headerNames = (const char **)calloc(inputs->count, sizeof(const char *));
+    for (int i = 0; i < inputs->count; i++) {
+        headerNames[i] = splitHeaderName(&names, &usedNames, inputs->files[i].fileName);
+    }
+
+    int *definingInputs = findDefiningInputs(inputs);
+    // The last input whose header included each one, so each is only included once
+    int *includedBy = (int *)malloc(inputs->count * sizeof(int));
+    for (int i = 0; i < inputs->count; i++) includedBy[i] = -1;
+
+    for (int i = 0; i < inputs->count; i++) {
+        InputFile *input = inputs->files + i;
+        if (isInputChanged && !isInputChanged[i]) continue;
+
+        output.size = 0;
+        outputf("#pragma once\n\n"
+                "#include \"%s\"\n", splitSharedHeaderName);
+
+        // The generated functions for members call the ones for their types, which may come from other inputs
+        for (Struct *s = input->firstStruct; s; s = s->next) {
+            for (StructMember *member = s->firstMember; member; member = member->next) {
+                if (member->isPointer) continue;
+                int type = stringHashFind(&stringHash, &member->type.text);
+                int other = type >= 0 ? definingInputs[type] : -1;
+                if (other < 0 || other == i || includedBy[other] == i) continue;
+                includedBy[other] = i;
+                outputf("#include \"%s\"\n", headerNames[other]);
+            }
+        }
+        outputf("\n");
+
+        for (Struct *s = input->firstStruct; s; s = s->next) {
+            outputStruct(s, linkage);
+        }
+
+        for (Enum *e = input->firstEnum; e; e = e->next) {
+            outputEnum(e, linkage);
+        }
+
+        flushOutput(joinPath(&names, directory, headerNames[i]), writeIfChanged);
     }
-    
-    return member;
-}
 
-static Struct *
-parseStruct(Tokenizer *tokenizer) {
-    Struct *new_struct = allocStruct(Struct);
+    // Always written, as it refers to every input. With a source file it only declares the tables, otherwise it has to
+    // come after the headers of all the inputs so everything it points at is defined.
+    TypeRegistry registry = {};
+    if (generateRegistry) {
+        buildTypeRegistry(&registry, inputs);
+
+        output.size = 0;
+        outputf("#pragma once\n\n"
+                "#include \"%s\"\n", splitSharedHeaderName);
+        if (!sourceFileName) {
+            for (int i = 0; i < inputs->count; i++) {
+                outputf("#include \"%s\"\n", headerNames[i]);
+            }
+        }
+        outputf("\n");
 
-    new_struct->name = requireToken(tokenizer, TokenType_Identifier);
+        outputRegistry(&registry, linkage);
+        flushOutput(joinPath(&names, directory, splitRegistryHeaderName), writeIfChanged);
+    }
 
-    requireToken(tokenizer, TokenType_LeftBrace);
+    if (sourceFileName) {
+        // The inputs provide the definitions that offsetof and the enum values need
+        output.size = 0;
+        for (int i = 0; i < inputs->count; i++) {
+            outputf("#include \"%s\"\n", inputs->files[i].fileName);
+        }
+        outputf("\n");
 
-    for (;;) {
-        Token token = getToken(tokenizer);
+        for (int i = 0; i < inputs->count; i++) {
+            outputf("#include \"%s\"\n", headerNames[i]);
+        }
+        if (generateRegistry) {
+            outputf("#include \"%s\"\n", splitRegistryHeaderName);
+        }
+        outputf("\n");
 
-        if (token.type == TokenType_RightBrace) {
-            break;
+        if (constTables) {
+            outputStringPool(TableLinkage_Global);
         }
 
-        stringHashPut(&token.text);
+        for (int i = 0; i < inputs->count; i++) {
+            for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+                outputStructTables(s, TableLinkage_Global);
+            }
+            for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+                outputEnumTables(e, TableLinkage_Global);
+            }
+        }
 
-        StructMember *member = parseStructMember(tokenizer, &token);
-        if (!new_struct->firstMember) {
-            new_struct->firstMember = member;
-        } else {
-            member->next = new_struct->firstMember;
-            new_struct->firstMember = member;
+        if (generateRegistry) {
+            outputRegistryTables(&registry, TableLinkage_Global);
         }
 
-        new_struct->memberCount++;
+        flushOutput(sourceFileName, writeIfChanged);
     }
-    requireToken(tokenizer, TokenType_Semicolon);
-
-    reverse(&new_struct->firstMember);
 
-    return new_struct;
+    freeTypeRegistry(&registry);
+    free(headerNames);
+    free(definingInputs);
+    free(includedBy);
+    stringHashFree(&usedNames);
+    arenaFree(&names);
 }
 
-static Enum *
-parseEnum(Tokenizer *tokenizer) {
-    Enum *new_enum = allocStruct(Enum);
+/*
+ * Watch mode
+ *
+ * --watch keeps every input parsed in memory and reparses them as they change on disk, so a build only has to ask
+ * for the outputs to be brought up to date rather than starting from scratch. An edit usually touches one definition,
+ * so an input is only tokenized again from the end of the last definition before the first byte that changed;
+ * everything before that is kept. Requests come in over a unix socket, see requestFlush.
+ */
 
-    new_enum->name = requireToken(tokenizer, TokenType_Identifier);
+struct OutputTargets {
+    const char *fileName;
+    const char *splitDirectory;
+    const char *splitSourceFileName;
+};
 
-    requireToken(tokenizer, TokenType_LeftBrace);
-    Token token = getToken(tokenizer);
+struct Watcher {
+    InputList *inputs;
+    OutputTargets targets;
+
+    // Per input, the inotify watch on its directory and its name within that directory
+    int *watches;
+    const char **baseNames;
+    // Seen an event for it since it was last read
+    bool *isChanged;
+    // Its outputs haven't been written since it was last parsed
+    bool *isStale;
+    // It failed to parse, so no outputs are written until it's fixed
+    bool *isBroken;
+    // From definitionsHash when the outputs were last written
+    uint64_t definitions;
+};
 
-    for (;;) {
-        if (token.type == TokenType_RightBrace) {
-            break;
+static void
+rebaseToken(Token *token, const char *from, const char *to) {
+    if (token->text.data) {
+        token->text.data = to + (token->text.data - from);
+    }
+}
+
+/*
+ * Reads an input that changed on disk again and reparses what might have changed. Returns false if it turns out to
+ * have the same contents as before.
+ */
+static bool
+reloadInput(InputFile *input) {
+    FileData previous = input->file;
+    input->file = openFile(input->fileName);
+
+    size_t same = 0;
+    if (previous.data) {
+        size_t limit = previous.size < input->file.size ? previous.size : input->file.size;
+        while (same < limit && previous.data[same] == input->file.data[same]) same++;
+
+        if (same == previous.size && same == input->file.size) {
+            closeFile(&input->file);
+            input->file = previous;
+            return false;
         }
+    }
 
-        EnumMember *member = allocStruct(EnumMember);
-        member->name = token;
+    // Definitions that end before the first change parse exactly the same, the text before them hasn't changed either
+    int keepEnd = 0;
+    if (previous.data && input->hasOffsets) {
+        for (Struct *s = input->firstStruct; s; s = s->next) {
+            if ((size_t)s->endOffset <= same && s->endOffset > keepEnd) keepEnd = s->endOffset;
+        }
+        for (Enum *e = input->firstEnum; e; e = e->next) {
+            if ((size_t)e->endOffset <= same && e->endOffset > keepEnd) keepEnd = e->endOffset;
+        }
+    }
 
-        token = getToken(tokenizer);
-        if (token.type == TokenType_Equals) {
-            // Don't care about the enum member value for now
-            Token value = getToken(tokenizer);
-            if (value.type != TokenType_Identifier && value.type != TokenType_Number) {
-                fatal("[%d:%d] Unknown enum value \"%.*s\"\n", value.line, value.column, value.text.length, value.text.data);
+    // Whatever is dropped stays in the arena, so start afresh once a whole file's worth has been parsed again
+    input->reparsedBytes += input->file.size - keepEnd;
+    if (keepEnd == 0 || input->reparsedBytes > input->file.size) {
+        arenaFree(&input->arena);
+        input->firstStruct = nullptr;
+        input->firstEnum = nullptr;
+        input->reparsedBytes = 0;
+        keepEnd = 0;
+    } else {
+        // The kept tokens point into the old contents, which are identical up to here
+        Struct **nextStruct = &input->firstStruct;
+        while (*nextStruct && (*nextStruct)->endOffset <= keepEnd) {
+            Struct *s = *nextStruct;
+            rebaseToken(&s->name, previous.data, input->file.data);
+            for (StructMember *member = s->firstMember; member; member = member->next) {
+                rebaseToken(&member->type, previous.data, input->file.data);
+                rebaseToken(&member->name, previous.data, input->file.data);
+                rebaseToken(&member->arraySize, previous.data, input->file.data);
             }
-            token = getToken(tokenizer);
-        } 
-
-        if (!new_enum->firstMember) {
-            new_enum->firstMember = member;
-        } else {
-            member->next = new_enum->firstMember;
-            new_enum->firstMember = member;
+            nextStruct = &s->next;
         }
-
-        new_enum->memberCount++;
-
-        if (token.type == TokenType_Comma) {
-            token = getToken(tokenizer);
+        *nextStruct = nullptr;
+
+        Enum **nextEnum = &input->firstEnum;
+        while (*nextEnum && (*nextEnum)->endOffset <= keepEnd) {
+            Enum *e = *nextEnum;
+            rebaseToken(&e->name, previous.data, input->file.data);
+            for (EnumMember *member = e->firstMember; member; member = member->next) {
+                rebaseToken(&member->name, previous.data, input->file.data);
+            }
+            nextEnum = &e->next;
         }
+        *nextEnum = nullptr;
     }
-    requireToken(tokenizer, TokenType_Semicolon);
 
-    reverse(&new_enum->firstMember);
+    closeFile(&previous);
 
-    return new_enum;
-}
+    // Until parsing succeeds, when parseFile sets it again
+    input->hasOffsets = false;
+    parseFile(input, keepEnd);
 
-static void 
-appendFlag(char *flags, const char *flag, int *index) {
-    if (*index != 0) {
-        memcpy(flags + *index, " | ", 3);
-        *index += 3;
+    // The stamp would have to be taken with the same read to be trusted, so just leave it to the next full run
+    if (useCache) {
+        input->isCacheable = false;
+        cache.isDirty = true;
     }
-    int flagLength = strlen(flag);
-    memcpy(flags + *index, flag, flagLength);
-    *index += flagLength;
+
+    return true;
 }
 
 /*
- * Output generation
+ * Order doesn't matter, a header only depends on other inputs through which names are introspected structs and enums,
+ * and which inputs they're in since it includes their headers.
  */
+static uint64_t
+definitionsHash(InputList *inputs) {
+    uint64_t structSum = 0;
+    uint64_t enumSum = 0;
+    for (int i = 0; i < inputs->count; i++) {
+        uint64_t input = (uint64_t)(i + 1) * 0xff51afd7ed558ccdull;
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            structSum += fnv1_hash(s->name.text.data, s->name.text.length) ^ input;
+        }
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            enumSum += fnv1_hash(e->name.text.data, e->name.text.length) ^ input;
+        }
+    }
+    return structSum ^ (enumSum * 0x9e3779b97f4a7c15ull);
+}
 
 static void
-outputPreamble() {
-    printf("#include <stddef.h>\n\n"
-           "#define meta_getMemberPtr(s, m) (void *)(((intptr_t)&(s)) + (m)->offset)\n"
-		   "#define meta_isArray(m) (((m)->flags & (Meta_StructMember_Flags_Array)) > 0)\n"
-		   "#define meta_isPointer(m) (((m)->flags & (Meta_StructMember_Flags_Pointer)) > 0)\n"
-           "\n"  
-           );
+regenerateOutputs(Watcher *watcher) {
+    uint64_t definitions = definitionsHash(watcher->inputs);
+    bool isDefinitionsChanged = definitions != watcher->definitions;
+
+    stringHashFree(&stringHash);
+    stringHashFree(&structNames);
+    stringHashFree(&enumNames);
+    stringPoolFree();
+    usedIntrospectOptions = 0;
+    output.size = 0;
+
+    internTypes(watcher->inputs);
+
+    OutputTargets *targets = &watcher->targets;
+    if (targets->splitDirectory) {
+        // Inline tables hold offsets into meta_strings, which move whenever any name does
+        bool isPoolShared = constTables && !targets->splitSourceFileName;
+        bool *isInputChanged = !isDefinitionsChanged && !isPoolShared ? watcher->isStale : nullptr;
+        generateSplitOutput(watcher->inputs, targets->splitDirectory, targets->splitSourceFileName, true, isInputChanged);
+    } else {
+        generateSingleOutput(watcher->inputs, targets->fileName, true);
+    }
+    watcher->definitions = definitions;
 }
 
 static void
-outputMetaDefinitions() {
-    printf("enum Meta_StructMember_Flags {\n"
-           "    Meta_StructMember_Flags_None    = 0,\n"
-           "    Meta_StructMember_Flags_Array   = 1,\n"
-           "    Meta_StructMember_Flags_Pointer = 2\n"
-           "};\n\n");
+tryReloadInput(Watcher *watcher, int index) {
+    jmp_buf jump;
+    fatalJump = &jump;
+    if (setjmp(jump) != 0) {
+        fatalJump = nullptr;
+        watcher->isBroken[index] = true;
+        return;
+    }
 
-    printf("struct Meta_Struct {\n");
-    printf("   const char *name;\n"); 
-    printf("   int memberCount;\n"); 
-    printf("};\n\n");
+    if (reloadInput(watcher->inputs->files + index)) {
+        watcher->isStale[index] = true;
+        watcher->isBroken[index] = false;
+    }
+    fatalJump = nullptr;
+}
 
-    printf("struct Meta_StructMember {\n"
-           "    const char *name;\n"
-           "    Meta_Type type;\n"
-           "    int flags;\n"
-           "    int arraySize;\n"
-           "    size_t offset;\n"
-           "};\n\n");
+/*
+ * Reparses every input with pending changes and rewrites the outputs that depend on them. Errors are reported and
+ * leave the outputs as they were until the next change. Returns whether the outputs are up to date.
+ */
+static bool
+updateOutputs(Watcher *watcher) {
+    InputList *inputs = watcher->inputs;
+    double start = getSeconds();
+
+    for (int i = 0; i < inputs->count; i++) {
+        if (!watcher->isChanged[i]) continue;
+        watcher->isChanged[i] = false;
+        tryReloadInput(watcher, i);
+    }
 
-    printf("struct Meta_Enum {\n");
-    printf("   const char *name;\n"); 
-    printf("   int memberCount;\n"); 
-    printf("};\n\n");
+    bool isAnyStale = false;
+    for (int i = 0; i < inputs->count; i++) {
+        if (watcher->isBroken[i]) return false;
+        isAnyStale |= watcher->isStale[i];
+    }
+    if (!isAnyStale) return true;
 
-    printf("struct Meta_EnumMember {\n"
-           "    const char *name;\n"
-           "    int value;\n"
-           "};\n\n");
+    jmp_buf jump;
+    fatalJump = &jump;
+    if (setjmp(jump) != 0) {
+        fatalJump = nullptr;
+        return false;
+    }
+    regenerateOutputs(watcher);
+    fatalJump = nullptr;
+
+    for (int i = 0; i < inputs->count; i++) {
+        watcher->isStale[i] = false;
+    }
+
+    fprintf(stderr, "[WATCH] Updated the outputs in %.1f ms\n", (getSeconds() - start) * 1000);
+    return true;
 }
 
+#ifdef __linux__
+
 static void
-outputTypesEnum() {
-    printf("enum Meta_Type {\n");
+readWatchEvents(Watcher *watcher, int inotifyFd) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) break;
 
-    for (int i = 0; i < arrayLength(stringHash); i++) {
-        StringHashEntry *entry = stringHash[i];
-        for (; entry; entry = entry->next) {
-            printf("    Meta_Type_%.*s,\n", entry->value.length, entry->value.data);
+        for (char *at = buffer; at < buffer + length;) {
+            struct inotify_event *event = (struct inotify_event *)at;
+            at += sizeof(struct inotify_event) + event->len;
+            if (!event->len) continue;
+
+            for (int i = 0; i < watcher->inputs->count; i++) {
+                if (watcher->watches[i] == event->wd && strcmp(watcher->baseNames[i], event->name) == 0) {
+                    watcher->isChanged[i] = true;
+                }
+            }
         }
     }
-
-    printf("};\n\n");
 }
 
-static void 
-outputStruct(Struct *s) {
-    printf("Meta_Struct meta_%.*s = { \"%.*s\", %d };\n\n", 
-            s->name.text.length, s->name.text.data, s->name.text.length, s->name.text.data, s->memberCount);
+/*
+ * Answers a single request from a client. Requests are one line, currently only "flush", which is answered with "ok"
+ * once every change made before it is written out or "error" if something doesn't parse.
+ */
+static void
+answerRequest(int client, bool isUpToDate) {
+    // Don't let a client that connects and says nothing hold everything up
+    struct timeval timeout = { 1, 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[64];
+    ssize_t length = read(client, request, sizeof(request) - 1);
+    request[length > 0 ? length : 0] = '\0';
+
+    const char *reply = "unknown request\n";
+    if (strncmp(request, "flush", 5) == 0) {
+        reply = isUpToDate ? "ok\n" : "error\n";
+    }
+    send(client, reply, strlen(reply), MSG_NOSIGNAL);
+}
 
-    printf("Meta_StructMember meta_%.*s_members[] = {\n", s->name.text.length, s->name.text.data);
+#endif
 
-    for (StructMember *member = s->firstMember; member; member = member->next) {
-        // TODO: This is stupid
-        char flags[512];
-        int index = 0;
-        bool hasFlags = false;
-        if (member->isPointer) {
-            hasFlags = true;
-            appendFlag(flags, "Meta_StructMember_Flags_Pointer", &index);
-        }
-        if (member->isArray) {
-            hasFlags = true;
-            appendFlag(flags, "Meta_StructMember_Flags_Array", &index);
+/*
+ * Runs until interrupted, keeping the outputs up to date with the inputs and answering requests on the socket.
+ */
+static void
+runWatch(InputList *inputs, OutputTargets *targets, const char *socketName) {
+#ifdef __linux__
+    Watcher watcher = {};
+    watcher.inputs = inputs;
+    watcher.targets = *targets;
+    watcher.watches = (int *)calloc(inputs->count, sizeof(int));
+    watcher.baseNames = (const char **)calloc(inputs->count, sizeof(const char *));
+    watcher.isChanged = (bool *)calloc(inputs->count, sizeof(bool));
+    watcher.isStale = (bool *)calloc(inputs->count, sizeof(bool));
+    watcher.isBroken = (bool *)calloc(inputs->count, sizeof(bool));
+    watcher.definitions = definitionsHash(inputs);
+
+    int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) 
+        fatal("Could not start watching the inputs\n");
+
+    // Editors often save by writing a new file and renaming it over the old one, so watch the directories instead
+    for (int i = 0; i < inputs->count; i++) {
+        const char *fileName = inputs->files[i].fileName;
+        const char *slash = strrchr(fileName, '/');
+        const char *directory = ".";
+        if (slash) {
+            int length = slash == fileName ? 1 : (int)(slash - fileName);
+            char *path = (char *)arenaPush(&globalArena, length + 1, 1);
+            memcpy(path, fileName, length);
+            directory = path;
         }
-        if (!hasFlags) {
-            appendFlag(flags, "Meta_StructMember_Flags_None", &index);
+
+        watcher.baseNames[i] = slash ? slash + 1 : fileName;
+        watcher.watches[i] = inotify_add_watch(inotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watcher.watches[i] < 0) 
+            fatal("Could not watch %s\n", directory);
+    }
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(address.sun_path)) 
+        fatal("Socket path %s is too long\n", socketName);
+    strcpy(address.sun_path, socketName);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketName);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) 
+        fatal("Could not listen on %s\n", socketName);
+
+    // Stop cleanly on Ctrl-C or kill, so the socket is removed and the cache saved
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    fprintf(stderr, "[WATCH] Watching %d inputs, listening on %s\n", inputs->count, socketName);
+
+    bool isUpToDate = true;
+    for (;;) {
+        struct pollfd fds[3] = {
+            { inotifyFd, POLLIN, 0 },
+            { listenFd, POLLIN, 0 },
+            { signalFd, POLLIN, 0 },
+        };
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            fatal("Could not wait for changes\n");
         }
-        flags[index] = '\0';
+        if (fds[2].revents) break;
 
-        printf("    { \"%.*s\", Meta_Type_%.*s, %s, %s%.*s, offsetof(%.*s, %.*s) },\n", 
-                member->name.text.length, member->name.text.data, 
-                member->type.text.length, member->type.text.data,
-                flags, !member->isArray ? "0" : "", 
-                member->arraySize.text.length, member->arraySize.text.data,
-                s->name.text.length, s->name.text.data, member->name.text.length, member->name.text.data);
+        // Always catch up on changes before answering, so a flush sees everything saved before it was sent
+        readWatchEvents(&watcher, inotifyFd);
+        isUpToDate = updateOutputs(&watcher);
+
+        if (fds[1].revents & POLLIN) {
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                answerRequest(client, isUpToDate);
+                close(client);
+            }
+        }
     }
 
-    printf("};\n\n");
+    close(signalFd);
+    close(listenFd);
+    unlink(socketName);
+    close(inotifyFd);
+
+    free(watcher.watches);
+    free(watcher.baseNames);
+    free(watcher.isChanged);
+    free(watcher.isStale);
+    free(watcher.isBroken);
+#else
+    fatal("--watch needs inotify, which is only available on Linux\n");
+#endif
+}
 
-    printf("inline Meta_Struct *meta_get(%.*s *s) {\n"
-           "    return &meta_%.*s;\n"
-           "}\n\n", 
-           s->name.text.length, s->name.text.data, s->name.text.length, s->name.text.data);
+/*
+ * Asks a --watch daemon to bring the outputs up to date, returning once it has.
+ */
+static int
+requestFlush(const char *socketName) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(address.sun_path)) 
+        fatal("Socket path %s is too long\n", socketName);
+    strcpy(address.sun_path, socketName);
 
-    printf("inline Meta_StructMember *meta_getMembers(%.*s *s) {\n"
-           "    return meta_%.*s_members;\n"
-           "}\n\n", 
-           s->name.text.length, s->name.text.data, s->name.text.length, s->name.text.data);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) 
+        fatal("Could not connect to %s, is metatool --watch running?\n", socketName);
+
+    writeAll(fd, "flush\n", 6, socketName);
+
+    char reply[64];
+    ssize_t length = read(fd, reply, sizeof(reply) - 1);
+    reply[length > 0 ? length : 0] = '\0';
+    close(fd);
+
+    if (strcmp(reply, "ok\n") != 0) 
+        fatal("The outputs couldn't be updated, see the --watch output for the error\n");
+
+    return 0;
 }
 
+/*
+ * Prints everything --stats collected to stderr, as text or as a single JSON object.
+ */
 static void
-outputEnum(Enum *e) {
-    printf("Meta_Enum meta_%.*s = { \"%.*s\", %d };\n\n", 
-            e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data, e->memberCount);
+printStatistics(InputList *inputs, int threadCount, double parseSeconds, double emitSeconds) {
+    int structCount = 0, structMemberCount = 0, enumCount = 0, enumMemberCount = 0;
+    for (int i = 0; i < inputs->count; i++) {
+        for (Struct *s = inputs->files[i].firstStruct; s; s = s->next) {
+            structCount++;
+            structMemberCount += s->memberCount;
+        }
+        for (Enum *e = inputs->files[i].firstEnum; e; e = e->next) {
+            enumCount++;
+            enumMemberCount += e->memberCount;
+        }
+    }
 
-    printf("Meta_EnumMember meta_%.*s_members[] = {\n", e->name.text.length, e->name.text.data);
-    for (EnumMember *member = e->firstMember; member; member = member->next) {
-        printf("    { \"%.*s\", %.*s },\n", member->name.text.length, member->name.text.data, member->name.text.length, member->name.text.data);
+    uint64_t tokenCount = 0;
+    for (int type = 0; type < TokenType_End; type++) {
+        tokenCount += phaseStats.tokenCounts[type];
     }
-    printf("};\n\n");
 
-    printf("const char *meta_%.*s_names[] = {\n", e->name.text.length, e->name.text.data);
-    for (EnumMember *member = e->firstMember; member; member = member->next) {
-        printf("    [%.*s] = \"%.*s\",\n", member->name.text.length, member->name.text.data, member->name.text.length, member->name.text.data);
+    int longestProbe;
+    double averageProbe;
+    stringHashProbeLengths(&stringHash, &longestProbe, &averageProbe);
+    double loadFactor = stringHash.slotCount ? (double)stringHash.count / stringHash.slotCount : 0;
+
+    // The tokenizing pass is a separate measurement of time already spent inside parseFile
+    double readSeconds = phaseStats.readNanoseconds * 1e-9;
+    double tokenizeSeconds = phaseStats.tokenizeNanoseconds * 1e-9;
+    double parseOnlySeconds = phaseStats.parseNanoseconds * 1e-9 - tokenizeSeconds;
+    if (parseOnlySeconds < 0) parseOnlySeconds = 0;
+
+    if (printStatsJson) {
+        fprintf(stderr, "{\"threads\":%d,\"read_seconds\":%.6f,\"tokenize_seconds\":%.6f,\"parse_seconds\":%.6f,"
+                        "\"parse_wall_seconds\":%.6f,\"emit_seconds\":%.6f,\"parsed_files\":%d,\"cached_files\":%d,",
+                threadCount, readSeconds, tokenizeSeconds, parseOnlySeconds, parseSeconds, emitSeconds,
+                phaseStats.parsedFileCount, phaseStats.cachedFileCount);
+        fprintf(stderr, "\"tokens\":{\"total\":%llu", (unsigned long long)tokenCount);
+        for (int type = 0; type < TokenType_End; type++) {
+            // Drop the TokenType_ prefix
+            fprintf(stderr, ",\"%s\":%llu", tokenTypeNames[type] + 10, (unsigned long long)phaseStats.tokenCounts[type]);
+        }
+        fprintf(stderr, "},\"structs\":%d,\"struct_members\":%d,\"enums\":%d,\"enum_members\":%d,",
+                structCount, structMemberCount, enumCount, enumMemberCount);
+        fprintf(stderr, "\"arena_allocations\":%llu,\"arena_bytes\":%llu,\"system_allocations\":%llu,\"system_bytes\":%llu,",
+                (unsigned long long)allocationStats.pushCount, (unsigned long long)allocationStats.pushBytes,
+                (unsigned long long)allocationStats.systemCount, (unsigned long long)allocationStats.systemBytes);
+        fprintf(stderr, "\"intern_entries\":%d,\"intern_slots\":%d,\"intern_load_factor\":%.4f,"
+                        "\"intern_longest_probe\":%d,\"intern_average_probe\":%.4f,",
+                stringHash.count, stringHash.slotCount, loadFactor, longestProbe, averageProbe);
+        fprintf(stderr, "\"output_files\":%d,\"output_bytes\":%llu,\"written_bytes\":%llu}\n",
+                phaseStats.outputFileCount, (unsigned long long)phaseStats.outputBytes,
+                (unsigned long long)phaseStats.writtenBytes);
+        return;
     }
-    printf("};\n\n");
 
-    printf("inline const char *meta_getName(%.*s value) {\n"
-           "    return meta_%.*s_names[value];\n"
-           "}\n\n", 
-           e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data);
+    fprintf(stderr, "[STATS] parsed in %.6f seconds, generated in %.6f seconds\n", parseSeconds, emitSeconds);
+    fprintf(stderr, "[STATS] read %.6f, tokenize %.6f, parse %.6f seconds summed over %d thread%s\n",
+            readSeconds, tokenizeSeconds, parseOnlySeconds, threadCount, threadCount == 1 ? "" : "s");
+    fprintf(stderr, "[STATS] %d files parsed, %d loaded from the cache\n", phaseStats.parsedFileCount, phaseStats.cachedFileCount);
+    fprintf(stderr, "[STATS] %llu tokens:", (unsigned long long)tokenCount);
+    for (int type = 0; type < TokenType_End; type++) {
+        if (!phaseStats.tokenCounts[type]) continue;
+        fprintf(stderr, " %s %llu", tokenTypeNames[type] + 10, (unsigned long long)phaseStats.tokenCounts[type]);
+    }
+    fprintf(stderr, "\n");
+    fprintf(stderr, "[STATS] %d structs with %d members, %d enums with %d members\n",
+            structCount, structMemberCount, enumCount, enumMemberCount);
+    fprintf(stderr, "[STATS] %llu arena allocations (%llu bytes) from %llu system allocations (%llu bytes)\n",
+            (unsigned long long)allocationStats.pushCount, (unsigned long long)allocationStats.pushBytes,
+            (unsigned long long)allocationStats.systemCount, (unsigned long long)allocationStats.systemBytes);
+    fprintf(stderr, "[STATS] %d types interned in %d slots, load factor %.2f, longest probe %d, average probe %.2f\n",
+            stringHash.count, stringHash.slotCount, loadFactor, longestProbe, averageProbe);
+    fprintf(stderr, "[STATS] %llu bytes generated in %d files, %llu bytes written\n",
+            (unsigned long long)phaseStats.outputBytes, phaseStats.outputFileCount,
+            (unsigned long long)phaseStats.writtenBytes);
+}
 
-    printf("inline Meta_Enum *meta_get(%.*s value) {\n"
-           "    return &meta_%.*s;\n"
-           "}\n\n", 
-           e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data);
-    
-    printf("inline Meta_EnumMember *meta_getMembers(%.*s value) {\n"
-           "    return meta_%.*s_members;\n"
-           "}\n\n", 
-           e->name.text.length, e->name.text.data, e->name.text.length, e->name.text.data);
+static void
+usage(const char *program) {
+    fatal("Usage: %s [-o <output.h> | --split <directory> [--split-source <output.cpp>]] [--write-if-changed] [--serialize] [--json] [--hash] [--delta] [--registry] [--const-tables] [--depfile <output.d>] [--cache <file>] [-j <threads>] [--scanner auto|scalar|sse2|avx2] [--no-skip-scan] [--benchmark-tokenizer] [--layout-report] [--stats | --stats-json] [--watch <socket>] <filename.cpp | @responsefile | ->...\n"
+          "       %s --flush <socket>\n", program, program);
 }
 
-/*
- * Main
- */
+int 
+main(int argc, char** argv) {
+    InputList inputs = {};
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *outputFileName = nullptr;
+    bool writeIfChanged = false;
+    const char *cacheFileName = nullptr;
+    const char *depfileName = nullptr;
+    const char *splitDirectory = nullptr;
+    const char *splitSourceFileName = nullptr;
+    ScannerKind scannerKind = ScannerKind_Auto;
+    bool benchmark = false;
+    bool layoutReport = false;
+    const char *watchSocketName = nullptr;
+    const char *flushSocketName = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "-j") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            threadCount = atoi(argv[i]);
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            threadCount = atoi(arg + 2);
+        } else if (strcmp(arg, "--scanner") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            scannerKind = ScannerKind_Count;
+            for (int kind = 0; kind < ScannerKind_Count; kind++) {
+                if (strcmp(argv[i], scannerKindNames[kind]) == 0) scannerKind = (ScannerKind)kind;
+            }
+            if (scannerKind == ScannerKind_Count) usage(argv[0]);
+        } else if (strcmp(arg, "-o") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            outputFileName = argv[i];
+        } else if (strcmp(arg, "--write-if-changed") == 0) {
+            writeIfChanged = true;
+        } else if (strcmp(arg, "--split") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            splitDirectory = argv[i];
+        } else if (strcmp(arg, "--split-source") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            splitSourceFileName = argv[i];
+        } else if (strcmp(arg, "--cache") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            cacheFileName = argv[i];
+        } else if (strcmp(arg, "--depfile") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            depfileName = argv[i];
+        } else if (strcmp(arg, "--serialize") == 0) {
+            generateSerializers = true;
+        } else if (strcmp(arg, "--json") == 0) {
+            generateJson = true;
+        } else if (strcmp(arg, "--hash") == 0) {
+            generateHash = true;
+        } else if (strcmp(arg, "--delta") == 0) {
+            generateDelta = true;
+        } else if (strcmp(arg, "--registry") == 0) {
+            generateRegistry = true;
+        } else if (strcmp(arg, "--const-tables") == 0) {
+            constTables = true;
+        } else if (strcmp(arg, "--stats") == 0) {
+            printStats = true;
+        } else if (strcmp(arg, "--stats-json") == 0) {
+            printStats = true;
+            printStatsJson = true;
+        } else if (strcmp(arg, "--no-skip-scan") == 0) {
+            skipScan = false;
+        } else if (strcmp(arg, "--benchmark-tokenizer") == 0) {
+            benchmark = true;
+        } else if (strcmp(arg, "--layout-report") == 0) {
+            layoutReport = true;
+        } else if (strcmp(arg, "--watch") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            watchSocketName = argv[i];
+        } else if (strcmp(arg, "--flush") == 0) {
+            if (++i >= argc) usage(argv[0]);
+            flushSocketName = argv[i];
+        } else if (arg[0] == '@') {
+            addResponseFile(&inputs, arg + 1);
+        } else {
+            addInputFile(&inputs, arg);
+        }
+    }
 
-static void
-processFile(const char *fileName) {
-    char* fileString = readFileToString(fileName);
+    if (flushSocketName) {
+        return requestFlush(flushSocketName);
+    }
 
-    Tokenizer tokenizer = {};
-    tokenizer.at = fileString;
-    tokenizer.line = 1;
-    tokenizer.column = 1;
+    if (inputs.count == 0 || (splitDirectory && outputFileName) || (splitSourceFileName && !splitDirectory)) {
+        usage(argv[0]);
+    }
 
-    bool isParsing = true;
+    if (watchSocketName) {
+        if ((!outputFileName && !splitDirectory) || layoutReport || benchmark) {
+            usage(argv[0]);
+        }
+        for (int i = 0; i < inputs.count; i++) {
+            if (strcmp(inputs.files[i].fileName, "-") == 0) 
+                fatal("--watch can't watch stdin\n");
+        }
+        copyInputs = true;
+        writeIfChanged = true;
+    }
 
-    Struct *firstStruct = nullptr;
-    Enum *firstEnum = nullptr;
+    if (splitDirectory) {
+        // The shared header is the first output of a split build, so it's what the depfile is about
+        outputFileName = nullptr;
+    }
 
-    while (isParsing) {
-        Token token = getToken(&tokenizer);
+    const char *depfileTarget = splitDirectory ? joinPath(&globalArena, splitDirectory, splitSharedHeaderName) : outputFileName;
+    if (depfileName && !depfileTarget) {
+        usage(argv[0]);
+    }
 
-        switch (token.type) {
-        case TokenType_End:
-            isParsing = false;
-            break;
+    if (benchmark) {
+        benchmarkTokenizer(&inputs);
+        return 0;
+    }
 
-        case TokenType_Unknown:
-            warn("[%d:%d] Unknown token \"%.*s\"\n", token.line, token.column, token.text.length, token.text.data);
-            break;
+    initScanner(scannerKind);
 
-        case TokenType_Identifier:
-            if (tokenMatchesString(&token, keyword_introspect)) {
-                // TODO parameters
-                requireToken(&tokenizer, TokenType_LeftParen);
-                requireToken(&tokenizer, TokenType_RightParen);
+    if (cacheFileName) {
+        loadCache(cacheFileName);
+    }
 
-                Token introspectType = requireToken(&tokenizer, TokenType_Identifier);
-                if (tokenMatchesString(&introspectType, keyword_struct)) {
-                    Struct *s = parseStruct(&tokenizer);
-                    if (!firstStruct) {
-                        firstStruct = s;
-                    } else {
-                        s->next = firstStruct;
-                        firstStruct = s;
-                    }
-                    break;
-                } else if (tokenMatchesString(&introspectType, keyword_enum)) {
-                    Enum *e = parseEnum(&tokenizer);
-                    if (!firstEnum) {
-                        firstEnum = e;
-                    } else {
-                        e->next = firstEnum;
-                        firstEnum = e;
-                    }
-                } else {
-                    fatal("[%d:%d] Unknown introspection target \"%.*s\"\n", introspectType.line, introspectType.column, 
-                            introspectType.text.length, introspectType.text.data);
-                }
-            }
+    double parseStart = getSeconds();
+    parseAllFiles(&inputs, threadCount);
+    double generateStart = getSeconds();
 
-        default:
-            break;
+    if (layoutReport) {
+        printLayoutReport(&inputs);
+    } else if (generateOutput) {
+        internTypes(&inputs);
+
+        if (splitDirectory) {
+            generateSplitOutput(&inputs, splitDirectory, splitSourceFileName, writeIfChanged);
+        } else {
+            generateSingleOutput(&inputs, outputFileName, writeIfChanged);
         }
     }
+    double generateEnd = getSeconds();
 
-    if (generateOutput) {
-        outputPreamble();
-        outputTypesEnum();
-        outputMetaDefinitions();
+    if (depfileName) {
+        writeDepfile(depfileName, depfileTarget, &inputs);
+    }
 
-        for (Struct *s = firstStruct; s; s = s->next) {
-            outputStruct(s);
-        }
+    if (watchSocketName) {
+        OutputTargets targets = {};
+        targets.fileName = outputFileName;
+        targets.splitDirectory = splitDirectory;
+        targets.splitSourceFileName = splitSourceFileName;
+        runWatch(&inputs, &targets, watchSocketName);
+    }
 
-        for (Enum *e = firstEnum; e; e = e->next) {
-            outputEnum(e);
-        }
+    if (cacheFileName) {
+        saveCache(cacheFileName, &inputs);
+        freeCache();
     }
-}
 
-int 
-main(int argc, char** argv) {
-    if (argc < 2) {
-      fatal("Usage: %s <filename.cpp>", argv[0]);
+    if (printStats) {
+        // Large inputs get the threads left over once every input has one
+        int parseThreadCount = inputs.count * threadsPerInput;
+        printStatistics(&inputs, threadCount < parseThreadCount ? threadCount : parseThreadCount, 
+                        generateStart - parseStart, generateEnd - generateStart);
+    }
+
+    for (int i = 0; i < inputs.count; i++) {
+        closeFile(&inputs.files[i].file);
+        arenaFree(&inputs.files[i].arena);
     }
-  
-    processFile(argv[1]);
+
+    free(output.data);
+    free(inputs.files);
+    free(inputs.dependencies);
+    stringHashFree(&stringHash);
+    stringHashFree(&structNames);
+    stringHashFree(&enumNames);
+    stringPoolFree();
+    arenaFree(&globalArena);
 
     return 0;
 }
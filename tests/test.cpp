@@ -0,0 +1,261 @@
+/*
+ * Checks that the generated code compiles without warnings and that every generator round trips. build.sh builds it
+ * against metatool's output for tests/test_common.h and tests/test_types.h with and without --const-tables, and with
+ * --split where meta_generated.h just includes the split headers, so only the parts of the API which are the same
+ * every way are used.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test_types.h"
+#include "meta_generated.h"
+
+static int failures = 0;
+
+#define check(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/*
+ * Fills an entity with the same values whatever was in its padding before.
+ */
+static void
+makeEntity(Entity *e, int garbage) {
+    memset(e, garbage, sizeof(*e));
+    e->id = 42;
+    e->kind = Kind_Large;
+    e->perms = Perms_ReadWrite;
+    e->position = { 1.5f, -2.25f, 1e-3f };
+    for (int i = 0; i < 3; i++) e->path[i] = { (float)i, (float)i * 0.1f, -(float)i };
+    e->active = true;
+    e->health = 97.125;
+    e->tag = (char *)"hero \"one\"\n";
+    for (int i = 0; i < 2; i++) {
+        // The bytes after the terminator are part of the member, not padding
+        memset(e->items[i].name, 0, sizeof(e->items[i].name));
+        snprintf(e->items[i].name, sizeof(e->items[i].name), "item%d", i);
+        e->items[i].count = (uint8_t)(200 + i);
+        e->items[i].id = -1234567890123ll * (i + 1);
+        e->items[i].note = i ? nullptr : (char *)"first";
+    }
+    e->flags = 0xBEEF;
+}
+
+static void
+testMetadata() {
+    Entity e;
+    makeEntity(&e, 0);
+
+    check(strcmp(meta_getName(meta_get(&e)), "Entity") == 0);
+    check(meta_get(&e)->memberCount == 10);
+    check(strcmp(meta_getName(meta_getMembers(&e) + 4), "path") == 0);
+    check(meta_getMembers(&e)[4].arraySize == 3);
+    check(*(double *)meta_getMemberPtr(e, meta_getMembers(&e) + 6) == e.health);
+
+    int count = 0;
+    meta_forEachMember(e, [&](auto field, auto &value) {
+        check(&(e.*field.pointer) == &value);
+        check(field.index == count);
+        count++;
+    });
+    check(count == 10);
+}
+
+static void
+testEnums() {
+    check(strcmp(meta_getName(Kind_Small), "Kind_Small") == 0);
+    check(meta_getName((Kind)5) == nullptr);
+
+    Kind kind;
+    check(meta_fromName("Kind_Large", &kind) && kind == Kind_Large);
+    check(!meta_fromName("Kind_Huge", &kind));
+    check(meta_isValid(Kind_Large) && !meta_isValid((Kind)3));
+
+    check(meta_isValid((Perms)(Perms_Read | Perms_Exec)) && !meta_isValid((Perms)8));
+
+    char buffer[64];
+    meta_formatFlags((Perms)(Perms_ReadWrite | Perms_Exec), buffer, sizeof(buffer));
+    check(strcmp(buffer, "Perms_ReadWrite | Perms_Exec") == 0);
+    meta_formatFlags((Perms)(Perms_Read | 16), buffer, sizeof(buffer));
+    check(strcmp(buffer, "Perms_Read | 0x10") == 0);
+}
+
+static void
+testSerialize() {
+    Entity e;
+    makeEntity(&e, 0xAA);
+
+    Meta_Writer writer = {};
+    meta_serialize(&writer, e);
+
+    Entity copy = {};
+    Meta_Reader reader = { writer.data, writer.size, 0, false };
+    check(meta_deserialize(&reader, &copy));
+    check(reader.position == writer.size);
+    check(meta_equals(e, copy));
+
+    Meta_Reader truncated = { writer.data, writer.size - 1, 0, false };
+    check(!meta_deserialize(&truncated, &copy));
+
+    free(writer.data);
+}
+
+static bool
+readJson(const char *json, Entity *e) {
+    Meta_JsonReader reader = { json, json + strlen(json), false };
+    return meta_readJson(&reader, e) && !reader.failed;
+}
+
+static void
+testJson() {
+    Entity e;
+    makeEntity(&e, 0x55);
+
+    char buffer[4096];
+    Meta_JsonWriter writer = { buffer, 0, sizeof(buffer), false };
+    meta_writeJson(&writer, e);
+    check(!writer.overflow);
+    buffer[writer.size] = '\0';
+
+    Entity copy = {};
+    check(readJson(buffer, &copy));
+    check(meta_equals(e, copy));
+
+    check(readJson("{\"flags\": 65535, \"kind\": 4, \"unknown\": [1, {\"a\": 2}]}", &copy));
+    check(copy.flags == 65535 && copy.kind == Kind_Small);
+    check(readJson("{\"id\": -2147483648, \"items\": [{\"count\": 2.55e2}]}", &copy));
+    check(copy.id == -2147483647 - 1 && copy.items[0].count == 255);
+
+    check(!readJson("{\"flags\": 65536}", &copy));
+    check(!readJson("{\"flags\": -1}", &copy));
+    check(!readJson("{\"id\": 3.7}", &copy));
+    check(!readJson("{\"id\": 99999999999999999999999}", &copy));
+    check(!readJson("{\"items\": [{\"id\": 9223372036854775808}]}", &copy));
+    check(!readJson("{\"kind\": \"Kind_Huge\"}", &copy));
+    check(!readJson("{\"id\": 1", &copy));
+}
+
+static void
+testHash() {
+    Entity a, b;
+    makeEntity(&a, 0x00);
+    makeEntity(&b, 0xFF);
+
+    // Only the padding differs
+    check(meta_equals(a, b));
+    check(meta_hash(a) == meta_hash(b));
+    check(meta_hash(a, 1) != meta_hash(a, 2));
+
+    char tag[] = "hero \"one\"\n";
+    b.tag = tag;
+    check(meta_equals(a, b) && meta_hash(a) == meta_hash(b));
+
+    b.items[1].count++;
+    check(!meta_equals(a, b));
+    check(meta_hash(a) != meta_hash(b));
+}
+
+static void
+testDelta() {
+    Entity previous, current;
+    makeEntity(&previous, 0x11);
+    makeEntity(&current, 0x22);
+    check(meta_isUnchanged(previous, current));
+    check(!meta_anyChanged(meta_diff(previous, current)));
+
+    current.health = 1.0;
+    current.items[1].count = 7;
+    current.tag = (char *)"villain";
+
+    auto mask = meta_diff(previous, current);
+    check(meta_isChanged(mask, Meta_Entity_Member_health));
+    check(meta_isChanged(mask, Meta_Entity_Member_items));
+    check(meta_isChanged(mask, Meta_Entity_Member_tag));
+    check(!meta_isChanged(mask, Meta_Entity_Member_id));
+    check(!meta_isChanged(mask, Meta_Entity_Member_path));
+
+    Meta_Writer writer = {};
+    meta_encodeDelta(&writer, previous, current);
+
+    Meta_Writer full = {};
+    meta_serialize(&full, current);
+    check(writer.size < full.size);
+
+    Entity state = previous;
+    Meta_Reader reader = { writer.data, writer.size, 0, false };
+    check(meta_applyDelta(&reader, &state));
+    check(reader.position == writer.size);
+    check(meta_equals(state, current));
+
+    free(writer.data);
+    free(full.data);
+}
+
+static void
+testRegistry() {
+    auto entity = meta_findType("Entity");
+    check(entity && entity->type == Meta_Type_Entity && entity->kind == Meta_TypeKind_Struct);
+    check(meta_getType(Meta_Type_Perms)->kind == Meta_TypeKind_Enum);
+    check(strcmp(meta_getName(meta_getType(Meta_Type_Vector)), "Vector") == 0);
+    check(meta_findType("Missing") == nullptr);
+
+    auto member = meta_findMember("Entity.health");
+    check(member && member->owner == Meta_Type_Entity && member->index == 6);
+    check(strcmp(meta_getName(member), "health") == 0);
+    member = meta_findMember("Kind.Kind_Large");
+    check(member && member->owner == Meta_Type_Kind && member->index == 2);
+    check(meta_findMember("Entity.missing") == nullptr);
+}
+
+static void
+testSoa() {
+    Particle_SoA particles = {};
+    for (int i = 0; i < 100; i++) {
+        Particle p = { { (float)i, 0, 0 }, { 0, (float)i, 0 }, (float)i };
+        check(meta_push(&particles, p) == i);
+    }
+    check(particles.count == 100);
+    check(((uintptr_t)particles.life & 63) == 0);
+
+    float total = 0;
+    for (float &life : meta_view(particles, &Particle_SoA::life)) total += life;
+    check(total == 4950);
+
+    meta_removeSwap(&particles, 10);
+    check(particles.count == 99 && meta_getElement(&particles, 10).life == 99);
+    meta_remove(&particles, 0);
+    check(particles.count == 98 && meta_getElement(&particles, 0).position.x == 1);
+
+    Particle items[98];
+    meta_copyToAoS(&particles, items);
+    check(items[9].velocity.y == 99);
+
+    meta_resize(&particles, 200);
+    check(particles.count == 200 && particles.life[199] == 0);
+
+    meta_free(&particles);
+}
+
+int
+main() {
+    testMetadata();
+    testEnums();
+    testSerialize();
+    testJson();
+    testHash();
+    testDelta();
+    testRegistry();
+    testSoa();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
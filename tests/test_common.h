@@ -0,0 +1,33 @@
+/*
+ * The types tests/test_types.h uses from another input, so that --split has to include their header from its own.
+ */
+
+#pragma once
+
+#define Introspect(...)
+
+Introspect()
+struct Vector {
+    float x;
+    float y;
+    float z;
+};
+
+Introspect()
+enum Kind {
+    Kind_None,
+    Kind_Small = 4,
+    Kind_Large = 1000
+};
+
+Introspect(flags)
+enum Perms {
+    Perms_Read = 1,
+    Perms_Write = 2,
+    Perms_Exec = 4,
+    Perms_ReadWrite = Perms_Read | Perms_Write
+};
+
+Introspect()
+enum Empty {
+};
@@ -0,0 +1,41 @@
+/*
+ * Input for the generated code test, build.sh runs metatool on this and tests/test_common.h with every generator
+ * enabled. Covers nested and array members, strings, padding, sparse, flags and empty enums and a structure of arrays.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "test_common.h"
+
+Introspect()
+struct Item {
+    char name[16];
+    uint8_t count;
+    // Padding after count
+    int64_t id;
+    char *note;
+};
+
+Introspect()
+struct Entity {
+    int id;
+    Kind kind;
+    Perms perms;
+    Vector position;
+    Vector path[3];
+    bool active;
+    // Padding after active
+    double health;
+    char *tag;
+    Item items[2];
+    uint16_t flags;
+};
+
+Introspect(soa)
+struct Particle {
+    Vector position;
+    Vector velocity;
+    float life;
+};